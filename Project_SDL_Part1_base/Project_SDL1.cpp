@@ -4,12 +4,30 @@
 #include "Project_SDL1.h"
 
 #include <algorithm>
+#include <climits>
 #include <cassert>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <numeric>
 #include <random>
 #include <string>
 #include <math.h>
+#include <new>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BLEND_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BLEND_SSE2
+#endif
+
+#if defined(ALLOC_GUARD) && defined(__GLIBC__)
+#include <execinfo.h>
+#define ALLOC_GUARD_STACKS
+#endif
 
 void init() {
   // Initialize SDL
@@ -24,322 +42,1839 @@ void init() {
                              std::string(IMG_GetError()));
 }
 
+appOptions parseOptions(int argc, char* argv[], int first) {
+  appOptions options;
+  for (int i = first; i < argc; i++) {
+    std::string option = argv[i];
+    if (option == "--late-input")
+      options.late_input = true;
+    else if (option == "--pipeline")
+      options.pipeline = true;
+    else if (option == "--tasks")
+      options.tasks = true;
+    else if (option == "--alloc-strict")
+      options.alloc_strict = true;
+    else if (option == "--herds")
+      options.herds = true;
+    else if (option == "--planned-motion")
+      options.planned_motion = true;
+    else if (option == "--render" && i + 1 < argc)
+      options.render = argv[++i];
+    else if (option == "--crowd" && i + 2 < argc) {
+      options.crowd_population = std::stoul(argv[++i]);
+      options.crowd_density = std::stoul(argv[++i]);
+      if (options.crowd_density == 1)
+        throw std::runtime_error("parseOptions(): --crowd density below 2");
+    }
+    else if (option == "--world" && i + 2 < argc) {
+      options.world_width = std::stoi(argv[++i]);
+      options.world_height = std::stoi(argv[++i]);
+      if (options.world_width < (int)frame_width ||
+          options.world_height < (int)frame_height)
+        throw std::runtime_error("parseOptions(): --world smaller than the window");
+    }
+    else if (option == "--zoom" && i + 1 < argc) {
+      options.zoom = std::stod(argv[++i]);
+      if (!(options.zoom > 0. && options.zoom <= 1.))
+        throw std::runtime_error("parseOptions(): --zoom not in ]0, 1]");
+    }
+    else if ((option == "--sheep-cap" || option == "--zombie-cap") && i + 2 < argc) {
+      size_t soft = std::stoul(argv[++i]);
+      size_t hard = std::stoul(argv[++i]);
+      if (soft > hard)
+        throw std::runtime_error("parseOptions(): " + option +
+                                 " soft cap above the hard cap");
+      if (option == "--sheep-cap") {
+        options.sheep_soft_cap = soft;
+        options.sheep_hard_cap = hard;
+      } else {
+        options.zombie_soft_cap = soft;
+        options.zombie_hard_cap = hard;
+      }
+    }
+    else
+      throw std::runtime_error("parseOptions(): unknown option " + option);
+  }
+  return options;
+}
+
  namespace {
 // Defining a namespace without a name -> Anonymous workspace
 // Its purpose is to indicate to the compiler that everything
 // inside of it is UNIQUELY used within this source file.
 
-} // namespace
+ // Prints mean, 95th percentile and max of a list of durations in ms
+ void printDurations(const std::string& name, std::vector<double> samples) {
+     if (samples.empty()) {
+         return;
+     }
+     double mean = std::accumulate(samples.begin(), samples.end(), 0.) /
+         samples.size();
+     auto p95 = samples.begin() + (samples.size() * 95) / 100;
+     std::nth_element(samples.begin(), p95, samples.end());
+     double p95_value = *p95;
+     double max = *std::max_element(samples.begin(), samples.end());
+     std::cout << name << " : mean " << mean << " ms, p95 " << p95_value
+         << " ms, max " << max << " ms" << std::endl;
+ }
+
+ // In 64 bits, the squares of the distances of a large world overflow an int
+ int distance(int x0, int y0, int x1, int y1) {
+     long long dx = (long long)x0 - x1;
+     long long dy = (long long)y0 - y1;
+     return (int)sqrt((double)(dx * dx + dy * dy));
+ }
+
+ // Random position in [low, high). RAND_MAX can be as low as 32767, too
+ // small for a large world, so two draws are combined.
+ int randomIn(int low, int high) {
+     long long draw = (long long)std::rand() * ((long long)RAND_MAX + 1) + std::rand();
+     return low + (int)(draw % (high - low));
+ }
+
+ // True when a w x h sprite at (x, y) of the window is out of it
+ bool offScreen(int x, int y, int w, int h) {
+     return x + w <= 0 || y + h <= 0 || x >= (int)frame_width || y >= (int)frame_height;
+ }
+
+ // The part of a w x h sprite drawn at (x, y) that lies in clip, false when
+ // nothing does
+ bool clipDraw(int x, int y, int w, int h, const SDL_Rect& clip, SDL_Rect& src,
+     SDL_Rect& dst) {
+     int x0 = std::max(x, clip.x);
+     int y0 = std::max(y, clip.y);
+     int x1 = std::min(x + w, clip.x + clip.w);
+     int y1 = std::min(y + h, clip.y + clip.h);
+     if (x0 >= x1 || y0 >= y1) {
+         return false;
+     }
+     src = { x0 - x, y0 - y, x1 - x0, y1 - y0 };
+     dst = { x0, y0, x1 - x0, y1 - y0 };
+     return true;
+ }
+} // namespace
+
+ // dst = src + dst * (255 - alpha of src) / 255 on every channel, src being
+ // premultiplied. The division rounds like (t + (t >> 8)) >> 8 with
+ // t = x + 128, which is the high half of t * 257. Blocks of pixels all
+ // transparent are skipped and blocks all opaque are copied.
+ void blendRow(Uint32* dst, const Uint32* src, int count) {
+     int i = 0;
+#ifdef BLEND_AVX2
+     {
+         const __m256i zero = _mm256_setzero_si256();
+         const __m256i alpha_mask = _mm256_set1_epi32((int)0xff000000);
+         const __m256i full = _mm256_set1_epi16(255);
+         const __m256i half = _mm256_set1_epi16(128);
+         const __m256i by_255 = _mm256_set1_epi16(257);
+         for (; i + 8 <= count; i += 8) {
+             __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+             __m256i alpha = _mm256_and_si256(s, alpha_mask);
+             if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(alpha, zero)) == -1) {
+                 continue;
+             }
+             __m256i* out = (__m256i*)(dst + i);
+             if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(alpha, alpha_mask)) == -1) {
+                 _mm256_storeu_si256(out, s);
+                 continue;
+             }
+             __m256i d = _mm256_loadu_si256(out);
+             __m256i a = _mm256_srli_epi32(s, 24);
+             a = _mm256_or_si256(a, _mm256_slli_epi32(a, 16));
+             __m256i lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero),
+                 _mm256_sub_epi16(full, _mm256_unpacklo_epi32(a, a)));
+             __m256i hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero),
+                 _mm256_sub_epi16(full, _mm256_unpackhi_epi32(a, a)));
+             lo = _mm256_mulhi_epu16(_mm256_add_epi16(lo, half), by_255);
+             hi = _mm256_mulhi_epu16(_mm256_add_epi16(hi, half), by_255);
+             _mm256_storeu_si256(out, _mm256_adds_epu8(s, _mm256_packus_epi16(lo, hi)));
+         }
+     }
+#endif
+#ifdef BLEND_SSE2
+     {
+         const __m128i zero = _mm_setzero_si128();
+         const __m128i alpha_mask = _mm_set1_epi32((int)0xff000000);
+         const __m128i full = _mm_set1_epi16(255);
+         const __m128i half = _mm_set1_epi16(128);
+         const __m128i by_255 = _mm_set1_epi16(257);
+         for (; i + 4 <= count; i += 4) {
+             __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+             __m128i alpha = _mm_and_si128(s, alpha_mask);
+             if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, zero)) == 0xffff) {
+                 continue;
+             }
+             __m128i* out = (__m128i*)(dst + i);
+             if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, alpha_mask)) == 0xffff) {
+                 _mm_storeu_si128(out, s);
+                 continue;
+             }
+             __m128i d = _mm_loadu_si128(out);
+             __m128i a = _mm_srli_epi32(s, 24);
+             a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+             __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero),
+                 _mm_sub_epi16(full, _mm_unpacklo_epi32(a, a)));
+             __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero),
+                 _mm_sub_epi16(full, _mm_unpackhi_epi32(a, a)));
+             lo = _mm_mulhi_epu16(_mm_add_epi16(lo, half), by_255);
+             hi = _mm_mulhi_epu16(_mm_add_epi16(hi, half), by_255);
+             _mm_storeu_si128(out, _mm_adds_epu8(s, _mm_packus_epi16(lo, hi)));
+         }
+     }
+#endif
+     for (; i < count; i++) {
+         Uint32 s = src[i];
+         Uint32 alpha = s >> 24;
+         if (alpha == 0) {
+             continue;
+         }
+         if (alpha == 255) {
+             dst[i] = s;
+             continue;
+         }
+         Uint32 d = dst[i];
+         Uint32 blended = 0;
+         for (int shift = 0; shift < 32; shift += 8) {
+             Uint32 t = ((d >> shift) & 0xff) * (255 - alpha) + 128;
+             Uint32 channel = ((s >> shift) & 0xff) + ((t + (t >> 8)) >> 8);
+             blended |= std::min(channel, 255u) << shift;
+         }
+         dst[i] = blended;
+     }
+ }
+
+ // Splits every row of the image into its runs
+ void encodeRuns(premultipliedImage& image) {
+     image.runs.clear();
+     image.row_runs.assign(1, 0);
+     for (int y = 0; y < image.h; y++) {
+         const Uint32* row = &image.pixels[(size_t)y * image.w];
+         int x = 0;
+         while (x < image.w) {
+             Uint32 alpha = row[x] >> 24;
+             int end = x + 1;
+             while (end < image.w && (row[end] >> 24 == 0) == (alpha == 0) &&
+                 (row[end] >> 24 == 255) == (alpha == 255)) {
+                 end++;
+             }
+             if (alpha != 0) {
+                 image.runs.push_back({ x, end - x, alpha == 255 });
+             }
+             x = end;
+         }
+         image.row_runs.push_back((int)image.runs.size());
+     }
+ }
+
+ // Draws the columns [src.x, src.x + src.w) of a row of the sprite: jumps
+ // over its transparent pixels, copies its opaque runs and blends the others
+ void drawRuns(Uint32* out, const premultipliedImage& sprite, int row,
+     const SDL_Rect& src) {
+     const Uint32* pixels = &sprite.pixels[(size_t)row * sprite.w];
+     int x1 = src.x + src.w;
+     for (int r = sprite.row_runs[row]; r < sprite.row_runs[row + 1]; r++) {
+         const spriteRun& run = sprite.runs[r];
+         int begin = std::max(run.x, src.x);
+         int end = std::min(run.x + run.length, x1);
+         if (begin >= end) {
+             if (run.x >= x1) {
+                 break;
+             }
+             continue;
+         }
+         if (run.opaque) {
+             memcpy(out + (begin - src.x), pixels + begin, (end - begin) * sizeof(Uint32));
+         }
+         else {
+             blendRow(out + (begin - src.x), pixels + begin, end - begin);
+         }
+     }
+ }
+
+ namespace {
+ // Draws the part of the sprite at (x, y) inside clip on a locked surface of
+ // ARGB8888 pixels
+ void blendDraw(const premultipliedImage& sprite, int x, int y,
+     SDL_Surface* target, const SDL_Rect& clip) {
+     SDL_Rect src, dst;
+     if (!clipDraw(x, y, sprite.w, sprite.h, clip, src, dst)) {
+         return;
+     }
+     Uint8* pixels = (Uint8*)target->pixels;
+     for (int row = 0; row < dst.h; row++) {
+         Uint32* out = (Uint32*)(pixels + (size_t)(dst.y + row) * target->pitch) + dst.x;
+         drawRuns(out, sprite, src.y + row, src);
+     }
+ }
+
+} // namespace
+
+#ifdef ALLOC_GUARD
+ namespace {
+ // Counters of allocGuard. They are written from operator new, so they are
+ // plain atomics, zero before any constructor runs.
+ constexpr int phase_count = allocGuard::phase_count;
+ const char* const phase_names[phase_count] = {
+     "other threads", "input", "rules", "update", "present", "pacing" };
+ std::atomic<unsigned long long> alloc_counts[phase_count];
+ std::atomic<unsigned long long> alloc_bytes[phase_count];
+ thread_local int current_phase = allocGuard::other;
+ std::atomic<bool> alloc_armed{ false };    // warm-up is over
+ std::atomic<bool> stack_captured{ false }; // first allocation of the frame
+ bool alloc_strict = false;
+ unsigned alloc_frames = 0;
+ unsigned alloc_violations = 0;
+ unsigned long long steady_counts[phase_count];
+ unsigned long long steady_bytes[phase_count];
+#ifdef ALLOC_GUARD_STACKS
+ void* first_stack[16];
+ int first_stack_depth = 0;
+#endif
+
+ void countAllocation(size_t bytes) {
+     alloc_counts[current_phase].fetch_add(1, std::memory_order_relaxed);
+     alloc_bytes[current_phase].fetch_add(bytes, std::memory_order_relaxed);
+#ifdef ALLOC_GUARD_STACKS
+     // backtrace() allocates with malloc, not with operator new
+     if (alloc_armed.load(std::memory_order_relaxed) && !stack_captured.exchange(true)) {
+         first_stack_depth = backtrace(first_stack, 16);
+     }
+#endif
+ }
+
+ void* allocate(size_t bytes) {
+     countAllocation(bytes);
+     void* ptr = std::malloc(bytes ? bytes : 1);
+     if (!ptr)
+         throw std::bad_alloc();
+     return ptr;
+ }
+ }
+
+ void* operator new(size_t bytes) { return allocate(bytes); }
+ void* operator new[](size_t bytes) { return allocate(bytes); }
+ void operator delete(void* ptr) noexcept { std::free(ptr); }
+ void operator delete[](void* ptr) noexcept { std::free(ptr); }
+ void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+ void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+#endif
+
+#ifdef ALLOC_GUARD
+ void allocGuard::enter(phase a_phase) { current_phase = a_phase; };
+
+ void allocGuard::setStrict(bool strict) { alloc_strict = strict; };
+#else
+ void allocGuard::enter(phase) {};
+
+ void allocGuard::setStrict(bool) {};
+#endif
+
+ void allocGuard::endFrame() {
+#ifdef ALLOC_GUARD
+     unsigned long long counts[phase_count];
+     unsigned long long bytes[phase_count];
+     unsigned long long frame_count = 0;
+     unsigned long long frame_bytes = 0;
+     for (int p = 0; p < phase_count; p++) {
+         counts[p] = alloc_counts[p].exchange(0);
+         bytes[p] = alloc_bytes[p].exchange(0);
+         frame_count += counts[p];
+         frame_bytes += bytes[p];
+     }
+     alloc_frames++;
+     if (!alloc_armed.load()) {
+         alloc_armed = alloc_frames >= warmup_frames;
+         stack_captured = false;
+         return;
+     }
+     for (int p = 0; p < phase_count; p++) {
+         steady_counts[p] += counts[p];
+         steady_bytes[p] += bytes[p];
+     }
+     if (frame_count > 0) {
+         alloc_violations++;
+         if (alloc_violations <= 5 || alloc_strict) {
+             std::cerr << "Frame " << alloc_frames << " allocated " << frame_count
+                 << " times (" << frame_bytes << " bytes):";
+             for (int p = 0; p < phase_count; p++) {
+                 if (counts[p] > 0) {
+                     std::cerr << " " << phase_names[p] << " " << counts[p];
+                 }
+             }
+             std::cerr << std::endl;
+#ifdef ALLOC_GUARD_STACKS
+             if (stack_captured.load()) {
+                 backtrace_symbols_fd(first_stack, first_stack_depth, 2);
+             }
+#endif
+         }
+         if (alloc_strict)
+             throw std::runtime_error("allocGuard::endFrame(): frame " +
+                 std::to_string(alloc_frames) + " allocated after warm-up");
+     }
+     stack_captured = false;
+#endif
+ };
+
+ void allocGuard::report() {
+#ifdef ALLOC_GUARD
+     if (alloc_frames <= warmup_frames) {
+         return;
+     }
+     std::cout << "Heap allocations after warm-up, " << alloc_frames - warmup_frames
+         << " frames, " << alloc_violations << " allocating" << std::endl;
+     for (int p = 0; p < phase_count; p++) {
+         std::cout << "  " << phase_names[p] << " : " << steady_counts[p] << " ("
+             << steady_bytes[p] << " bytes)" << std::endl;
+     }
+#endif
+ };
+
+ namespace {
+ // Half the size of image, each pixel the mean of 2 x 2 pixels. The colors
+ // being premultiplied, the transparent pixels do not darken the edges.
+ premultipliedImage halve(const premultipliedImage& image) {
+     premultipliedImage half;
+     half.w = std::max(1, image.w / 2);
+     half.h = std::max(1, image.h / 2);
+     half.pixels.resize((size_t)half.w * half.h);
+     for (int y = 0; y < half.h; y++) {
+         const Uint32* row0 = &image.pixels[(size_t)std::min(2 * y, image.h - 1) * image.w];
+         const Uint32* row1 = &image.pixels[(size_t)std::min(2 * y + 1, image.h - 1) * image.w];
+         for (int x = 0; x < half.w; x++) {
+             int x0 = std::min(2 * x, image.w - 1);
+             int x1 = std::min(2 * x + 1, image.w - 1);
+             Uint32 pixel = 0;
+             for (int shift = 0; shift < 32; shift += 8) {
+                 Uint32 sum = ((row0[x0] >> shift) & 0xff) + ((row0[x1] >> shift) & 0xff) +
+                     ((row1[x0] >> shift) & 0xff) + ((row1[x1] >> shift) & 0xff);
+                 pixel |= ((sum + 2) / 4) << shift;
+             }
+             half.pixels[(size_t)y * half.w + x] = pixel;
+         }
+     }
+     encodeRuns(half);
+     return half;
+ }
+
+ // One opaque pixel of the mean color of the visible pixels of image
+ premultipliedImage dot(const premultipliedImage& image) {
+     unsigned long long sums[4] = {};
+     for (Uint32 pixel : image.pixels) {
+         for (int channel = 0; channel < 4; channel++) {
+             sums[channel] += (pixel >> (8 * channel)) & 0xff;
+         }
+     }
+     Uint32 pixel = 0xff000000;
+     for (int channel = 0; channel < 3 && sums[3] > 0; channel++) {
+         pixel |= (Uint32)std::min(255ull, (sums[channel] * 255 + sums[3] / 2) / sums[3])
+             << (8 * channel);
+     }
+     premultipliedImage a_dot;
+     a_dot.w = 1;
+     a_dot.h = 1;
+     a_dot.pixels.assign(1, pixel);
+     encodeRuns(a_dot);
+     return a_dot;
+ }
+
+ // The surface of image with its colors back to straight alpha, for the
+ // SDL blits
+ SDL_Surface* straightSurface(const premultipliedImage& image) {
+     SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, image.w, image.h, 32,
+         SDL_PIXELFORMAT_ARGB8888);
+     if (!surface)
+         throw std::runtime_error("straightSurface(): " + std::string(SDL_GetError()));
+     for (int y = 0; y < image.h; y++) {
+         Uint32* row = (Uint32*)((Uint8*)surface->pixels + (size_t)y * surface->pitch);
+         for (int x = 0; x < image.w; x++) {
+             Uint32 pixel = image.pixels[(size_t)y * image.w + x];
+             Uint32 alpha = pixel >> 24;
+             Uint32 straight = alpha << 24;
+             for (int shift = 0; shift < 24 && alpha > 0; shift += 8) {
+                 straight |= std::min(255u, (((pixel >> shift) & 0xff) * 255 + alpha / 2) /
+                     alpha) << shift;
+             }
+             row[x] = straight;
+         }
+     }
+     return surface;
+ }
+ } // namespace
+
+ spriteBank::spriteBank() {
+     sprites_.reserve(max_sprites);
+     premultiplied_.reserve(max_sprites);
+     mips_.reserve(max_sprites);
+ };
+
+ spriteBank::~spriteBank() {
+     for (auto sprite : sprites_) {
+         SDL_FreeSurface(sprite);
+     }
+ };
+
+ spriteBank& spriteBank::get() {
+     static spriteBank bank;
+     return bank;
+ };
+
+ int spriteBank::load(const std::string& file_path) {
+     std::lock_guard<std::mutex> lock(mutex_);
+     auto found = ids_.find(file_path);
+     if (found != ids_.end()) {
+         return found->second;
+     }
+     if (sprites_.size() + mip_levels + 1 > max_sprites)
+         throw std::runtime_error("spriteBank::load(): too many images, " +
+             file_path);
+     SDL_Surface* sprite = IMG_Load(file_path.c_str());
+     if (!sprite)
+         throw std::runtime_error("spriteBank::load(): "
+             "Could not load " +
+             file_path +
+             "\n Error: " + std::string(SDL_GetError()));
+     return this->store(file_path, sprite);
+ };
+
+ int spriteBank::add(const std::string& name, SDL_Surface* sprite) {
+     std::lock_guard<std::mutex> lock(mutex_);
+     auto found = ids_.find(name);
+     if (found != ids_.end()) {
+         SDL_FreeSurface(sprite);
+         return found->second;
+     }
+     if (sprites_.size() + mip_levels + 1 > max_sprites) {
+         SDL_FreeSurface(sprite);
+         throw std::runtime_error("spriteBank::add(): too many images, " + name);
+     }
+     return this->store(name, sprite);
+ };
+
+ // Keeps the sprite, its premultiplied copy and its levels
+ int spriteBank::store(const std::string& name, SDL_Surface* sprite) {
+     SDL_Surface* argb = SDL_ConvertSurfaceFormat(sprite, SDL_PIXELFORMAT_ARGB8888, 0);
+     if (!argb) {
+         SDL_FreeSurface(sprite);
+         throw std::runtime_error("spriteBank::store(): " + std::string(SDL_GetError()));
+     }
+     premultipliedImage image;
+     image.w = argb->w;
+     image.h = argb->h;
+     image.pixels.resize((size_t)argb->w * argb->h);
+     for (int y = 0; y < argb->h; y++) {
+         const Uint32* row = (const Uint32*)((const Uint8*)argb->pixels + (size_t)y * argb->pitch);
+         for (int x = 0; x < argb->w; x++) {
+             Uint32 pixel = row[x];
+             Uint32 alpha = pixel >> 24;
+             Uint32 premultiplied = alpha << 24;
+             for (int shift = 0; shift < 24; shift += 8) {
+                 premultiplied |= ((((pixel >> shift) & 0xff) * alpha + 127) / 255) << shift;
+             }
+             image.pixels[(size_t)y * argb->w + x] = premultiplied;
+         }
+     }
+     SDL_FreeSurface(argb);
+     encodeRuns(image);
+     int id = this->keep(sprite, std::move(image));
+     ids_[name] = id;
+     std::array<int, mip_levels + 1> levels;
+     levels[0] = id;
+     for (int level = 1; level < mip_levels; level++) {
+         premultipliedImage half = halve(premultiplied_[levels[level - 1]]);
+         SDL_Surface* surface = straightSurface(half);
+         levels[level] = this->keep(surface, std::move(half));
+     }
+     premultipliedImage a_dot = dot(premultiplied_[id]);
+     SDL_Surface* surface = straightSurface(a_dot);
+     levels[mip_levels] = this->keep(surface, std::move(a_dot));
+     for (int level : levels) {
+         mips_[level] = levels;
+     }
+     return id;
+ };
+
+ int spriteBank::keep(SDL_Surface* sprite, premultipliedImage image) {
+     sprites_.push_back(sprite);
+     premultiplied_.push_back(std::move(image));
+     mips_.emplace_back();
+     return (int)sprites_.size() - 1;
+ };
+
+ int spriteBank::tint(int id, const std::string& name, Uint32 rgb) {
+     SDL_Surface* tinted = SDL_ConvertSurfaceFormat(this->surface(id),
+         SDL_PIXELFORMAT_ARGB8888, 0);
+     if (!tinted)
+         throw std::runtime_error("spriteBank::tint(): " + std::string(SDL_GetError()));
+     for (int y = 0; y < tinted->h; y++) {
+         Uint32* row = (Uint32*)((Uint8*)tinted->pixels + (size_t)y * tinted->pitch);
+         for (int x = 0; x < tinted->w; x++) {
+             Uint32 pixel = row[x] & 0xff000000;
+             for (int shift = 0; shift < 24; shift += 8) {
+                 pixel |= ((((row[x] >> shift) & 0xff) * ((rgb >> shift) & 0xff) + 127) / 255)
+                     << shift;
+             }
+             row[x] = pixel;
+         }
+     }
+     return this->add(name, tinted);
+ };
+
+ SDL_Surface* spriteBank::surface(int id) const { return sprites_[id]; };
+
+ const premultipliedImage& spriteBank::premultiplied(int id) const {
+     return premultiplied_[id];
+ };
+
+ int spriteBank::scaled(int id, double zoom) const {
+     if (zoom >= 1.) {
+         return id;
+     }
+     const premultipliedImage& image = premultiplied_[id];
+     if (std::max(image.w, image.h) * zoom < dot_size) {
+         return mips_[id][mip_levels];
+     }
+     int level = std::clamp((int)lround(-log2(zoom)), 0, mip_levels - 1);
+     return mips_[id][level];
+ };
+
+ renderBackend::renderBackend() : frames_{ 0 }, sprites_{ 0 } {};
+
+ renderBackend::~renderBackend() {};
+
+ void renderBackend::report() const {
+     std::cout << "Render backend: " << this->name() << ", " << this->frames_
+         << " frames, " << (double)this->sprites_ / std::max(1ull, this->frames_)
+         << " sprites per frame" << std::endl;
+ };
+
+ void renderBackend::invalidate() {};
+
+ bool renderBackend::tiles() const { return false; };
+
+ void renderBackend::beginTiles(int /*background*/, const spriteDraw* /*draws*/,
+     size_t /*count*/) {};
+
+ void renderBackend::drawTile(const SDL_Rect& /*tile*/, const int* /*order*/,
+     size_t /*count*/) {};
+
+ void renderBackend::endTiles() {};
+
+ dirtyRegion::dirtyRegion(int width, int height)
+     : width_{ width }, height_{ height },
+     columns_{ (width + cell_size - 1) / cell_size },
+     rows_{ (height + cell_size - 1) / cell_size },
+     cells_(columns_ * rows_, dirty) {};
+
+ void dirtyRegion::reset(state a_state) {
+     std::fill(this->cells_.begin(), this->cells_.end(), a_state);
+ };
+
+ // Only clean cells become dirty, the drawn ones stay drawn
+ void dirtyRegion::mark(const spriteDraw& draw) {
+     SDL_Surface* sprite = spriteBank::get().surface(draw.sprite);
+     int x0 = std::max(draw.x, 0);
+     int y0 = std::max(draw.y, 0);
+     int x1 = std::min(draw.x + sprite->w, this->width_);
+     int y1 = std::min(draw.y + sprite->h, this->height_);
+     if (x0 >= x1 || y0 >= y1) {
+         return;
+     }
+     for (int r = y0 / cell_size; r <= (y1 - 1) / cell_size; r++) {
+         for (int c = x0 / cell_size; c <= (x1 - 1) / cell_size; c++) {
+             char& cell = this->cells_[r * this->columns_ + c];
+             if (cell == clean) {
+                 cell = dirty;
+             }
+         }
+     }
+ };
+
+ // The matches keep the order of both lists, so the draws left unmarked are
+ // stacked the same way in both frames. A draw that differs is taken as an
+ // animal that moved, unless skipping one draw on either side realigns the
+ // lists (one animal gone or born).
+ void dirtyRegion::diff(const spriteDraw* before, size_t before_count,
+     const spriteDraw* after, size_t after_count) {
+     auto same = [](const spriteDraw& a, const spriteDraw& b) {
+         return a.sprite == b.sprite && a.x == b.x && a.y == b.y;
+     };
+     size_t i = 0;
+     size_t j = 0;
+     while (i < before_count || j < after_count) {
+         if (i < before_count && j < after_count && same(before[i], after[j])) {
+             i++;
+             j++;
+         }
+         else if (j == after_count ||
+             (i < before_count && before[i].sprite < after[j].sprite)) {
+             this->mark(before[i++]);
+         }
+         else if (i == before_count || after[j].sprite < before[i].sprite) {
+             this->mark(after[j++]);
+         }
+         else if (i + 1 < before_count && same(before[i + 1], after[j])) {
+             this->mark(before[i++]);
+         }
+         else if (j + 1 < after_count && same(before[i], after[j + 1])) {
+             this->mark(after[j++]);
+         }
+         else {
+             this->mark(before[i++]);
+             this->mark(after[j++]);
+         }
+     }
+ };
+
+ void dirtyRegion::promote(state from, state to) {
+     std::replace(this->cells_.begin(), this->cells_.end(), (char)from, (char)to);
+ };
+
+ size_t dirtyRegion::count(state a_state) const {
+     return std::count(this->cells_.begin(), this->cells_.end(), (char)a_state);
+ };
+
+ size_t dirtyRegion::size() const { return this->cells_.size(); };
+
+ surfaceBackend::surfaceBackend(SDL_Window* window)
+     : window_{ window }, surface_{ SDL_GetWindowSurface(window) }, blend_{ false },
+     background_{ -1 }, previous_background_{ -1 }, tiled_segments_{ 0 },
+     region_{ surface_ ? surface_->w : 0, surface_ ? surface_->h : 0 },
+     full_frames_{ 0 }, partial_frames_{ 0 }, dirty_cells_{ 0 } {
+     if (!this->surface_)
+         throw std::runtime_error("surfaceBackend(): " + std::string(SDL_GetError()));
+     const SDL_PixelFormat* format = this->surface_->format;
+     this->blend_ = format->BytesPerPixel == 4 && format->Rmask == 0xff0000 &&
+         format->Gmask == 0xff00 && format->Bmask == 0xff;
+     this->rects_.reserve(this->region_.size());
+ };
+
+ const char* surfaceBackend::name() const { return "surface"; };
+
+ void surfaceBackend::lock() {
+     if (SDL_MUSTLOCK(this->surface_) && SDL_LockSurface(this->surface_) < 0)
+         throw std::runtime_error("surfaceBackend::lock(): " +
+             std::string(SDL_GetError()));
+ };
+
+ void surfaceBackend::unlock() {
+     if (SDL_MUSTLOCK(this->surface_)) {
+         SDL_UnlockSurface(this->surface_);
+     }
+ };
+
+ void surfaceBackend::drawClipped(int sprite, int x, int y, const SDL_Rect& clip) {
+     spriteBank& bank = spriteBank::get();
+     if (this->blend_) {
+         blendDraw(bank.premultiplied(sprite), x, y, this->surface_, clip);
+         return;
+     }
+     SDL_Surface* image = bank.surface(sprite);
+     SDL_Rect src, dst;
+     if (clipDraw(x, y, image->w, image->h, clip, src, dst)) {
+         SDL_LowerBlit(image, &src, this->surface_, &dst);
+     }
+ };
+
+ void surfaceBackend::compose(const SDL_Rect& clip, size_t first) {
+     if (first == 0 && this->background_ >= 0) {
+         this->drawClipped(this->background_, 0, 0, clip);
+     }
+     for (size_t i = first; i < this->frame_.size(); i++) {
+         this->drawClipped(this->frame_[i].sprite, this->frame_[i].x, this->frame_[i].y,
+             clip);
+     }
+ };
+
+ // Compares the draw() from first to last with the ones of the previous
+ // frame, everything is dirty when the frames are not made the same way
+ void surfaceBackend::diffSegments(size_t first, size_t last) {
+     if (this->background_ != this->previous_background_ ||
+         this->previous_segments_.size() < last) {
+         this->region_.promote(dirtyRegion::clean, dirtyRegion::dirty);
+         return;
+     }
+     for (size_t s = first; s < last; s++) {
+         size_t before = s ? this->previous_segments_[s - 1] : 0;
+         size_t after = s ? this->segments_[s - 1] : 0;
+         this->region_.diff(this->previous_.data() + before,
+             this->previous_segments_[s] - before, this->frame_.data() + after,
+             this->segments_[s] - after);
+     }
+     size_t changed = this->region_.size() - this->region_.count(dirtyRegion::clean);
+     if (changed > full_redraw * this->region_.size()) {
+         this->region_.promote(dirtyRegion::clean, dirtyRegion::dirty);
+     }
+ };
+
+ void surfaceBackend::clear(int background) {
+     this->background_ = background;
+     this->frame_.clear();
+     this->segments_.clear();
+     this->tiled_segments_ = 0;
+ };
+
+ void surfaceBackend::draw(const spriteDraw* draws, size_t count) {
+     this->frame_.insert(this->frame_.end(), draws, draws + count);
+     this->segments_.push_back(this->frame_.size());
+     this->sprites_ += count;
+ };
+
+ void surfaceBackend::present() {
+     if (this->tiled_segments_ == 0) {
+         this->region_.reset(dirtyRegion::clean);
+     }
+     this->diffSegments(this->tiled_segments_, this->segments_.size());
+     if (this->previous_segments_.size() != this->segments_.size()) {
+         this->region_.promote(dirtyRegion::clean, dirtyRegion::dirty);
+     }
+     // The cells drawn by the tiles only miss the draws that came after
+     SDL_Rect window = { 0, 0, this->surface_->w, this->surface_->h };
+     size_t first = this->tiled_segments_ ? this->segments_[this->tiled_segments_ - 1] : 0;
+     this->lock();
+     this->region_.forEachRun(dirtyRegion::dirty, window,
+         [this](const SDL_Rect& run) { this->compose(run, 0); });
+     if (first < this->frame_.size()) {
+         this->region_.forEachRun(dirtyRegion::drawn, window,
+             [this, first](const SDL_Rect& run) { this->compose(run, first); });
+     }
+     this->unlock();
+
+     size_t clean = this->region_.count(dirtyRegion::clean);
+     if (clean == 0) {
+         SDL_UpdateWindowSurface(this->window_);
+         this->full_frames_++;
+     }
+     else if (clean < this->region_.size()) {
+         this->rects_.clear();
+         auto add = [this](const SDL_Rect& run) { this->rects_.push_back(run); };
+         this->region_.forEachRun(dirtyRegion::dirty, window, add);
+         this->region_.forEachRun(dirtyRegion::drawn, window, add);
+         SDL_UpdateWindowSurfaceRects(this->window_, this->rects_.data(),
+             (int)this->rects_.size());
+         this->partial_frames_++;
+     }
+     this->dirty_cells_ += this->region_.size() - clean;
+     this->frames_++;
+
+     this->previous_background_ = this->background_;
+     std::swap(this->previous_, this->frame_);
+     std::swap(this->previous_segments_, this->segments_);
+ };
+
+ void surfaceBackend::report() const {
+     renderBackend::report();
+     std::cout << "  full redraws : " << this->full_frames_ << ", partial : "
+         << this->partial_frames_ << ", unchanged : "
+         << this->frames_ - this->full_frames_ - this->partial_frames_
+         << ", dirty area " << 100. * this->dirty_cells_ /
+         std::max(1ull, this->frames_ * this->region_.size()) << " %" << std::endl;
+ };
+
+ // Without a previous frame every cell is redrawn and updated. The surface
+ // of the window is fetched again, a resize frees the old one.
+ void surfaceBackend::invalidate() {
+     this->surface_ = SDL_GetWindowSurface(this->window_);
+     if (!this->surface_)
+         throw std::runtime_error("surfaceBackend::invalidate(): " +
+             std::string(SDL_GetError()));
+     this->previous_background_ = -1;
+     this->previous_.clear();
+     this->previous_segments_.clear();
+ };
+
+ bool surfaceBackend::tiles() const { return this->blend_; };
+
+ // The tiles redraw the cells that differ in the first list
+ void surfaceBackend::beginTiles(int background, const spriteDraw* draws,
+     size_t count) {
+     this->clear(background);
+     this->draw(draws, count);
+     this->region_.reset(dirtyRegion::clean);
+     this->diffSegments(0, 1);
+     this->region_.promote(dirtyRegion::dirty, dirtyRegion::drawn);
+     this->tiled_segments_ = 1;
+     this->lock();
+ };
+
+ // Each pixel goes through the same blends in the same order as with
+ // compose(), so the frame does not depend on the tiles
+ void surfaceBackend::drawTile(const SDL_Rect& tile, const int* order, size_t count) {
+     this->region_.forEachRun(dirtyRegion::drawn, tile, [&](const SDL_Rect& run) {
+         this->drawClipped(this->background_, 0, 0, run);
+         for (size_t i = 0; i < count; i++) {
+             const spriteDraw& draw = this->frame_[order[i]];
+             this->drawClipped(draw.sprite, draw.x, draw.y, run);
+         }
+     });
+ };
+
+ void surfaceBackend::endTiles() { this->unlock(); };
+
+ rendererBackend::rendererBackend(SDL_Window* window)
+     : renderer_{ SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE) },
+     background_{ -1 } {
+     if (!this->renderer_)
+         throw std::runtime_error("rendererBackend(): " + std::string(SDL_GetError()));
+ };
+
+ rendererBackend::~rendererBackend() {
+     for (SDL_Texture* a_texture : this->textures_) {
+         if (a_texture) {
+             SDL_DestroyTexture(a_texture);
+         }
+     }
+     SDL_DestroyRenderer(this->renderer_);
+ };
+
+ const char* rendererBackend::name() const { return "renderer"; };
+
+ SDL_Texture* rendererBackend::texture(int sprite) {
+     if (sprite >= (int)this->textures_.size()) {
+         this->textures_.resize(sprite + 1, nullptr);
+     }
+     if (!this->textures_[sprite]) {
+         this->textures_[sprite] = SDL_CreateTextureFromSurface(this->renderer_,
+             spriteBank::get().surface(sprite));
+         if (!this->textures_[sprite])
+             throw std::runtime_error("rendererBackend::texture(): " +
+                 std::string(SDL_GetError()));
+     }
+     return this->textures_[sprite];
+ };
+
+ void rendererBackend::copy(int sprite, int x, int y) {
+     SDL_Surface* a_surface = spriteBank::get().surface(sprite);
+     SDL_Rect rect = { x, y, a_surface->w, a_surface->h };
+     SDL_RenderCopy(this->renderer_, this->texture(sprite), NULL, &rect);
+ };
+
+ void rendererBackend::clear(int background) {
+     this->background_ = background;
+     this->pending_.clear();
+ };
+
+ void rendererBackend::draw(const spriteDraw* draws, size_t count) {
+     this->pending_.insert(this->pending_.end(), draws, draws + count);
+ };
+
+ void rendererBackend::present() {
+     if (this->background_ >= 0) {
+         this->copy(this->background_, 0, 0);
+     }
+     for (const auto& draw : this->pending_) {
+         this->copy(draw.sprite, draw.x, draw.y);
+     }
+     SDL_RenderPresent(this->renderer_);
+     this->sprites_ += this->pending_.size();
+     this->frames_++;
+ };
+
+ const char* nullBackend::name() const { return "null"; };
+
+ void nullBackend::clear(int /*background*/) {};
+
+ void nullBackend::draw(const spriteDraw* /*draws*/, size_t count) {
+     this->sprites_ += count;
+ };
+
+ void nullBackend::present() { this->frames_++; };
+
+ std::unique_ptr<renderBackend> makeRenderBackend(const std::string& name,
+     SDL_Window* window) {
+     if (name == "surface")
+         return std::make_unique<surfaceBackend>(window);
+     if (name == "renderer")
+         return std::make_unique<rendererBackend>(window);
+     if (name == "null")
+         return std::make_unique<nullBackend>();
+     throw std::runtime_error("makeRenderBackend(): unknown backend " + name);
+ };
+
+ renderedObject::renderedObject(const std::string& file_path, int pos_x,
+     int pos_y)
+     : pos_x_{ pos_x }, pos_y_{ pos_y } {
+     this->set_image_ptr(file_path);
+ };
+
+ renderedObject::~renderedObject() {
+     this->image_ptr_ = nullptr;
+ };
+
+ int renderedObject::get_pos_x() const { return this->pos_x_; };
+ int renderedObject::get_pos_y() const { return this->pos_y_; };
+ int renderedObject::get_sprite() const { return this->sprite_; };
+
+ void renderedObject::set_pos(int pos_x, int pos_y) {
+     this->pos_x_ = pos_x;
+     this->pos_y_ = pos_y;
+ };
+
+ void renderedObject::set_image_ptr(const std::string& file_path) {
+     sprite_ = spriteBank::get().load(file_path);
+     image_ptr_ = spriteBank::get().surface(sprite_);
+ };
+
+ movingObject::movingObject(const std::string& file_path, int pos_x,
+     int pos_y, int vit_x, int vit_y)
+     : renderedObject(file_path, pos_x, pos_y),
+     vit_x_{ vit_x }, vit_y_{ vit_y } {};
+
+ movingObject::~movingObject() {};
+
+ int movingObject::world_width_ = frame_width;
+ int movingObject::world_height_ = frame_height;
+
+ void movingObject::verifPosition() {
+     int boundary = frame_boundary;
+     if (pos_x_ <= boundary) {
+         vit_x_ = std::abs(vit_x_);
+         pos_x_ = boundary;
+     }
+     else if (pos_x_ >= world_width_ - boundary) {
+         vit_x_ = -std::abs(vit_x_);
+         pos_x_ = world_width_ - boundary;
+     }
+
+     if (pos_y_ <= boundary) {
+         vit_y_ = std::abs(vit_y_);
+         pos_y_ = boundary;
+     }
+     else if (pos_y_ >= world_height_ - boundary) {
+         vit_y_ = -std::abs(vit_y_);
+         pos_y_ = world_height_ - boundary;
+     }
+ };
+
+ // Before the first animal is built
+ void movingObject::setWorld(int width, int height) {
+     world_width_ = width;
+     world_height_ = height;
+ };
+
+ int movingObject::worldWidth() { return world_width_; };
+ int movingObject::worldHeight() { return world_height_; };
+
+ int movingObject::getVit_x() const { return this->vit_x_; };
+ int movingObject::getVit_y() const { return this->vit_y_; };
+
+ void movingObject::setVit_x(int vit_x) { this->vit_x_ = vit_x; };
+ void movingObject::setVit_y(int vit_y) { this->vit_y_ = vit_y; };
+
+ interactiveObject::interactiveObject(const std::string& file_path, int pos_x,
+     int pos_y, int vit_x, int vit_y)
+     : movingObject(file_path, pos_x, pos_y, vit_x, vit_y),
+     timers_{ nullptr }, herd_{ -1 }, alive_{ true }, idle_{ false } {};
+
+ interactiveObject::~interactiveObject() {};
+
+ std::vector<std::string>& interactiveObject::getProperties() {
+     return this->properties_;
+ };
+
+ bool interactiveObject::isAlive() const { return this->alive_; };
+
+ void interactiveObject::kill() {
+     this->alive_ = false;
+     this->properties_[3] = "dead";
+ };
+
+ void interactiveObject::saveState(int index) {
+     this->syncPosition();
+     this->previous_.index = index;
+     this->previous_.pos_x = this->pos_x_;
+     this->previous_.pos_y = this->pos_y_;
+     this->previous_.step_x = 0;
+     this->previous_.step_y = 0;
+     this->saveProperties();
+ };
+
+ void interactiveObject::saveProperties() {
+     // The species and the sex never change
+     if (this->previous_.kind == species::count) {
+         this->previous_.kind = speciesOf(this->properties_[0]);
+         this->previous_.gender = sexOf(this->properties_[1]);
+     }
+     // Same sizes every tick: the strings keep their buffers
+     this->previous_.properties = this->properties_;
+ };
+
+ bool interactiveObject::idle() const { return this->idle_; };
+
+ void interactiveObject::reindex(int index) { this->previous_.index = index; };
+
+ unsigned long long interactiveObject::tick() const {
+     return this->timers_ ? this->timers_->now() : 0;
+ };
+
+ namespace {
+ // The class of every species, for the handlers of its pairs
+ template <species S> struct speciesClass;
+ template <> struct speciesClass<species::sheep> { using type = sheep; };
+ template <> struct speciesClass<species::wolf> { using type = wolf; };
+ template <> struct speciesClass<species::zombie> { using type = zombie; };
+ template <> struct speciesClass<species::dog> { using type = dog; };
+ template <> struct speciesClass<species::sheperd> { using type = sheperd; };
+
+ // What an A does to a B at (other_x, other_y), only instantiated for the
+ // pairs of pair_rules
+ template <species A, species B>
+ bool pairHandler(interactiveObject& self, const entityState& other, int other_x,
+     int other_y, intentList& intents) {
+     constexpr pairRule rule = pairRuleOf(A, B);
+     auto& actor = static_cast<typename speciesClass<A>::type&>(self);
+     if constexpr (rule.what == reaction::flee) {
+         return actor.escape(other_x, other_y);
+     }
+     else if constexpr (rule.what == reaction::eat) {
+         // A zombie hit by the sheperd backs off instead
+         if constexpr (A == species::zombie && B == species::sheperd) {
+             if (actor.getProperties()[5] == "true") {
+                 return actor.recule(other_x, other_y);
+             }
+         }
+         if (actor.croque(other_x, other_y)) {
+             intents.push_back({ intent::kill, actor.getPrevious().index, other.index });
+             return true;
+         }
+         return false;
+     }
+     else if constexpr (rule.what == reaction::mate) {
+         // The reproduction timers are set when the intent is accepted
+         if ((other.properties[2] == "0") &&
+             actor.reproduit(other_x, other_y)) {
+             intents.push_back({ intent::mate, actor.getPrevious().index, other.index });
+             return true;
+         }
+         return false;
+     }
+     else {
+         static_assert(rule.what == reaction::follow, "pairHandler(): unknown reaction");
+         return actor.follow(other_x, other_y);
+     }
+ }
+
+ using pairFn = bool (*)(interactiveObject&, const entityState&, int, int, intentList&);
+
+ template <species A, species B>
+ constexpr pairFn pairHandlerOf() {
+     if constexpr (pairRuleOf(A, B).what == reaction::none)
+         return nullptr;
+     else
+         return &pairHandler<A, B>;
+ }
+
+ template <species A, size_t... B>
+ constexpr std::array<pairFn, species_count> pairRow(std::index_sequence<B...>) {
+     return { { pairHandlerOf<A, (species)B>()... } };
+ }
+
+ template <size_t... A>
+ constexpr std::array<std::array<pairFn, species_count>, species_count> pairTable(
+     std::index_sequence<A...>) {
+     return { { pairRow<(species)A>(std::make_index_sequence<species_count>())... } };
+ }
+
+ // pair_handlers[actor][other], nullptr for the pairs without a rule
+ constexpr auto pair_handlers = pairTable(std::make_index_sequence<species_count>());
+
+ // What an actor of a species and sex looks for, from its rules: the
+ // squared radius (-1: ignored, LLONG_MAX: anywhere), the rank and the sex
+ // wanted of every species, and the ranks with a rule reaching anywhere
+ struct pairReach {
+     long long dist2[species_count];
+     int rank[species_count];
+     sex wanted[species_count];
+     bool unbounded[rule_ranks];
+     bool herded[rule_ranks]; // the rules reaching anywhere only want sheep
+ };
+
+ struct pairReachTable {
+     pairReach of[species_count][(size_t)sex::count];
+ };
+
+ constexpr pairReach pairReachOf(species actor, sex actor_sex) {
+     pairReach reach{};
+     for (size_t other = 0; other < species_count; other++) {
+         pairRule rule = pairRuleOf(actor, (species)other);
+         bool applies = rule.what != reaction::none &&
+             (rule.actor_sex == sex::count || rule.actor_sex == actor_sex);
+         reach.dist2[other] = !applies ? -1 :
+             rule.radius < 0 ? LLONG_MAX : (long long)rule.radius * rule.radius;
+         reach.rank[other] = rule.rank;
+         reach.wanted[other] = rule.other_sex;
+         if (applies && rule.radius < 0) {
+             bool first = !reach.unbounded[rule.rank];
+             reach.herded[rule.rank] = (first || reach.herded[rule.rank]) &&
+                 (species)other == species::sheep;
+             reach.unbounded[rule.rank] = true;
+         }
+     }
+     return reach;
+ }
+
+ constexpr pairReachTable pairReaches() {
+     pairReachTable table{};
+     for (size_t actor = 0; actor < species_count; actor++) {
+         for (size_t gender = 0; gender < (size_t)sex::count; gender++) {
+             table.of[actor][gender] = pairReachOf((species)actor, (sex)gender);
+         }
+     }
+     return table;
+ }
+
+ constexpr pairReachTable pair_reach = pairReaches();
+
+ const pairReach& reachOf(const entityState& state) {
+     return pair_reach.of[(size_t)state.kind][(size_t)state.gender];
+ }
+
+ // Keeps other in the slot of its rank when the rule allows it and it is
+ // the nearest so far. Equal distances go to the lowest index, so the
+ // result does not depend on the order of the visits.
+ void offerNearest(const pairReach& reach, const entityState& other,
+     long long dist, nearSlot* slots) {
+     size_t kind = (size_t)other.kind;
+     nearSlot& slot = slots[reach.rank[kind]];
+     if (dist < reach.dist2[kind] &&
+         (reach.wanted[kind] == sex::count || reach.wanted[kind] == other.gender) &&
+         (dist < slot.dist || (dist == slot.dist && other.index < slot.index))) {
+         slot = { dist, other.index };
+     }
+ }
+ }
+
+ bool interactiveObject::interact(const entityState& other, intentList& intents) {
+     assert(this->previous_.kind != species::count && other.kind != species::count);
+     pairFn handler = pair_handlers[(size_t)this->previous_.kind][(size_t)other.kind];
+     unsigned long long now = this->tick();
+     return handler != nullptr &&
+         handler(*this, other, other.x(now), other.y(now), intents);
+ };
+
+ const entityState& interactiveObject::getPrevious() const {
+     return this->previous_;
+ };
+
+ void interactiveObject::syncPosition() {};
+
+ int interactiveObject::getHerd() const { return this->herd_; };
+
+ void interactiveObject::setHerd(int herd) { this->herd_ = herd; };
+
+ void interactiveObject::setTimerWheel(timerWheel* timers) {
+     this->timers_ = timers;
+ };
+
+ frameArena::frameArena(size_t capacity)
+     : block_{ new char[capacity] }, capacity_{ capacity }, used_{ 0 },
+     needed_{ 0 }, peak_{ 0 }, fallbacks_{ 0 } {};
+
+ void* frameArena::allocate(size_t bytes, size_t alignment) {
+     uintptr_t base = reinterpret_cast<uintptr_t>(this->block_.get());
+     size_t start = ((base + this->used_ + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+     this->needed_ += bytes + alignment;
+     if (start + bytes <= this->capacity_) {
+         this->used_ = start + bytes;
+         this->peak_ = std::max(this->peak_, this->used_);
+         return this->block_.get() + start;
+     }
+     this->fallbacks_++;
+     this->overflow_.emplace_back(new char[bytes + alignment]);
+     uintptr_t extra = reinterpret_cast<uintptr_t>(this->overflow_.back().get());
+     return reinterpret_cast<void*>((extra + alignment - 1) & ~(uintptr_t)(alignment - 1));
+ };
+
+ // Only the ticks that overflowed pay for the growth of the block
+ void frameArena::reset() {
+     if (!this->overflow_.empty()) {
+         this->capacity_ = std::max(2 * this->capacity_, this->needed_);
+         this->block_.reset(new char[this->capacity_]);
+         this->overflow_.clear();
+     }
+     this->peak_ = std::max(this->peak_, this->needed_);
+     this->used_ = 0;
+     this->needed_ = 0;
+ };
+
+ size_t frameArena::capacity() const { return this->capacity_; };
+
+ size_t frameArena::peak() const { return this->peak_; };
+
+ unsigned frameArena::fallbacks() const { return this->fallbacks_; };
+
+ timerWheel::timer::timer(std::function<void()> expire)
+     : expire_{ std::move(expire) }, wheel_{ nullptr }, slot_{ nullptr },
+     prev_{ nullptr }, next_{ nullptr }, deadline_{ 0 } {};
+
+ timerWheel::timer::~timer() {
+     if (this->wheel_) {
+         this->wheel_->cancel(*this);
+     }
+ };
+
+ bool timerWheel::timer::active() const { return this->wheel_ != nullptr; };
+
+ timerWheel::timerWheel() : now_{ 0 }, pending_{ 0 } {
+     for (auto& level : this->slots_) {
+         std::fill(std::begin(level), std::end(level), nullptr);
+     }
+ };
+
+ // The timers still scheduled belong to objects that outlive the wheel
+ timerWheel::~timerWheel() {
+     for (auto& level : this->slots_) {
+         for (timer* head : level) {
+             while (head) {
+                 timer* next = head->next_;
+                 head->wheel_ = nullptr;
+                 head->prev_ = nullptr;
+                 head->next_ = nullptr;
+                 head = next;
+             }
+         }
+     }
+ };
+
+ // The level is the first one whose slots reach the deadline from now
+ void timerWheel::insert(timer& a_timer) {
+     unsigned long long delta = a_timer.deadline_ - this->now_;
+     int level = 0;
+     while (level < levels - 1 && delta >= (1ull << (slot_bits * (level + 1)))) {
+         level++;
+     }
+     timer*& head = this->slots_[level][(a_timer.deadline_ >> (slot_bits * level)) & (slots - 1)];
+     a_timer.slot_ = &head;
+     a_timer.prev_ = nullptr;
+     a_timer.next_ = head;
+     if (head) {
+         head->prev_ = &a_timer;
+     }
+     head = &a_timer;
+ };
+
+ void timerWheel::unlink(timer& a_timer) {
+     if (a_timer.prev_) {
+         a_timer.prev_->next_ = a_timer.next_;
+     }
+     else {
+         *a_timer.slot_ = a_timer.next_;
+     }
+     if (a_timer.next_) {
+         a_timer.next_->prev_ = a_timer.prev_;
+     }
+     a_timer.prev_ = nullptr;
+     a_timer.next_ = nullptr;
+ };
+
+ void timerWheel::schedule(timer& a_timer, unsigned delay) {
+     if (a_timer.wheel_) {
+         this->cancel(a_timer);
+     }
+     a_timer.deadline_ = this->now_ + std::max(delay, 1u);
+     a_timer.wheel_ = this;
+     this->insert(a_timer);
+     this->pending_++;
+ };
+
+ void timerWheel::cancel(timer& a_timer) {
+     if (a_timer.wheel_ != this) {
+         return;
+     }
+     this->unlink(a_timer);
+     a_timer.wheel_ = nullptr;
+     this->pending_--;
+ };
+
+ void timerWheel::advance() {
+     this->now_++;
+     // Upper levels first, their timers may land in a slot cascaded below
+     for (int level = levels - 1; level > 0; level--) {
+         if (this->now_ & ((1ull << (slot_bits * level)) - 1)) {
+             continue;
+         }
+         timer*& head = this->slots_[level][(this->now_ >> (slot_bits * level)) & (slots - 1)];
+         timer* a_timer = head;
+         head = nullptr;
+         while (a_timer) {
+             timer* next = a_timer->next_;
+             this->insert(*a_timer);
+             a_timer = next;
+         }
+     }
+     // A timer can schedule itself again from its callback
+     timer*& due = this->slots_[0][this->now_ & (slots - 1)];
+     while (due) {
+         timer& a_timer = *due;
+         this->cancel(a_timer);
+         a_timer.expire_();
+     }
+ };
+
+ unsigned long long timerWheel::now() const { return this->now_; };
+
+ unsigned timerWheel::remaining(const timer& a_timer) const {
+     if (a_timer.wheel_ != this) {
+         return 0;
+     }
+     return (unsigned)(a_timer.deadline_ - this->now_);
+ };
+
+ size_t timerWheel::pending() const { return this->pending_; };
+
+ sheperd::sheperd()
+     : interactiveObject("sheperd.png", 0, 0, 0, 0) {
+     pos_x_ = randomIn(frame_boundary, world_width_ - frame_boundary);
+     pos_y_ = randomIn(frame_boundary, world_height_ - frame_boundary);
+     this->properties_.push_back("sheperd");
+     this->properties_.push_back("male");
+     this->properties_.push_back("0");
+     this->properties_.push_back("alive");
+     this->properties_.push_back("none");
+     this->properties_.push_back("false");
+ };
+
+ sheperd::~sheperd() {};
+
+ void sheperd::move() {
+     pos_x_ += (frame_time * vit_x_);
+     pos_y_ += (frame_time * vit_y_);
+
+     this->verifPosition();
+ };
+
+
+ animal::animal(const std::string& file_path, int pos_x, int pos_y, int vit_x,
+     int vit_y)
+     : interactiveObject(file_path, pos_x, pos_y, vit_x, vit_y), escapeState_{ calm }, boostEnded_{ false },
+     escapeTimer_{ [this] { this->escapeTimerExpired(); } } {};
+
+ animal::animal(const std::string& file_path)
+     : interactiveObject(file_path, 0, 0, 0, 0),
+     escapeState_{ calm }, boostEnded_{ false },
+     escapeTimer_{ [this] { this->escapeTimerExpired(); } } {};
+
+ animal::~animal() {};
+
+ // escape() runs during the decisions and only marks the boost, the timer
+ // is started here because the wheel is not shared with the other threads.
+ // The move of the escape counts as the first tick of the boost.
+ void animal::updateEscape() {
+     if (this->escapeState_ == boosted && !this->escapeTimer_.active() &&
+         this->timers_) {
+         this->timers_->schedule(this->escapeTimer_, boost_ticks - 1);
+     }
+ };
+
+ void animal::escapeTimerExpired() {
+     if (this->escapeState_ == boosted) {
+         this->escapeState_ = recovering;
+         this->boostEnded_ = true;
+         this->timers_->schedule(this->escapeTimer_, recovery_ticks);
+     }
+     else {
+         this->escapeState_ = calm;
+     }
+ };
+
+ sheep::sheep(int pos_x, int pos_y, int vit_x, int vit_y,
+     const std::string& couleur)
+     : animal("sheep.png", pos_x, pos_y, vit_x, vit_y),
+     reproductionTimer_{ [this] { this->reproductionOver(); } },
+     escape_{ false }, planned_{ false }, plan_tick_{ 0 }, plan_x_{ 0 }, plan_y_{ 0 },
+     step_x_{ 0 }, step_y_{ 0 }, next_turn_{ 0 }, next_speed_{ 0 },
+     motionTimer_{ [this] { this->motionEvent(); } } {
+     this->properties_.push_back("sheep");
+     sex gender = std::rand() % 2 == 0 ? sex::male : sex::female;
+     this->properties_.push_back(gender == sex::male ? "male" : "female");
+     this->properties_.push_back("0");
+     this->properties_.push_back("alive");
+
+     // Without a color, a first sheep is red, blue, yellow or white
+     static const sheepColor first_colors[4] = { sheepColor::red, sheepColor::blue,
+         sheepColor::yellow, sheepColor::white };
+     sheepColor color = colorOf(couleur);
+     if (color == sheepColor::none) {
+         color = first_colors[std::rand() % 4];
+     }
+     this->properties_.push_back(colorName(color));
+     this->sprite_ = sheepSprites::get().sprite(gender, color);
+     this->image_ptr_ = spriteBank::get().surface(this->sprite_);
+     this->properties_.push_back("false");
+ }
+
+ sheep::sheep()
+     : sheep(0, 0, 0, 0, "none") {
+     pos_x_ = randomIn(frame_boundary, world_width_ - frame_boundary);
+     pos_y_ = randomIn(frame_boundary, world_height_ - frame_boundary);
+
+     if (std::rand() % 2 == 0) {
+         vit_x_ = -20;
+     }
+     else {
+         vit_x_ = 20;
+     }
+     if (std::rand() % 2 == 0) {
+         vit_y_ = -20;
+     }
+     else {
+         vit_y_ = 20;
+     }
+ };
+
+ sheep::~sheep() {};
+
+ void sheep::move() {
+
+     if (this->planned_) {
+         // Nothing to do until the next event of the path
+         if (!this->escape_ && this->wandering()) {
+             return;
+         }
+         // The event of this tick may already have made the move
+         bool moved = this->plan_tick_ == this->timers_->now();
+         this->unplan();
+         if (moved) {
+             return;
+         }
+     }
+
+     this->updateEscape();
+
+     if (!escape_ &&
+         (this->properties_[1] != "male" ||
+             (this->properties_[1] == "male" && reproductionTimer_.active()))) {
+         if (this->boostEnded_) {
+             this->newSpeed();
+         }
+         else if (this->escapeState_ != boosted) {
+             if (std::rand() % 200 == 0) {
+                 this->turn();
+             }
+
+             if (std::rand() % 50 == 0) {
+                 this->newSpeed();
+             }
+         }
+     }
+
+     pos_x_ += (frame_time * vit_x_);
+     pos_y_ += (frame_time * vit_y_);
 
- renderedObject::renderedObject(const std::string& file_path,
-     SDL_Surface* window_surface_ptr, int pos_x,
-     int pos_y)
-     : window_surface_ptr_{ window_surface_ptr }, pos_x_{ pos_x }, pos_y_{ pos_y } {
-     image_ptr_ = IMG_Load(file_path.c_str());
-     if (!image_ptr_)
-         throw std::runtime_error("animal::animal(): "
-             "Could not load " +
-             file_path +
-             "\n Error: " + std::string(SDL_GetError()));
- };
+     this->escape_ = false;
+     this->boostEnded_ = false;
 
- renderedObject::~renderedObject() {
-     SDL_FreeSurface(image_ptr_);
-     this->image_ptr_ = nullptr;
+     this->verifPosition();
+
+     if (planned_motion_ && this->wandering()) {
+         this->plan();
+     }
  };
 
- int renderedObject::get_pos_x() const { return this->pos_x_; };
- int renderedObject::get_pos_y() const { return this->pos_y_; };
+ bool sheep::planned_motion_ = false;
 
- void renderedObject::set_image_ptr(const std::string& file_path) {
-     image_ptr_ = IMG_Load(file_path.c_str());
-     if (!image_ptr_)
-         throw std::runtime_error("animal::animal(): "
-             "Could not load " +
-             file_path +
-             "\n Error: " + std::string(SDL_GetError()));
+ void sheep::setPlannedMotion(bool planned_motion) {
+     planned_motion_ = planned_motion;
  };
 
- movingObject::movingObject(const std::string& file_path,
-     SDL_Surface* window_surface_ptr, int pos_x,
-     int pos_y, int vit_x, int vit_y)
-     : renderedObject(file_path, window_surface_ptr, pos_x, pos_y),
-     vit_x_{ vit_x }, vit_y_{ vit_y } {};
+ // Walks around at random: what move() does when nothing chases the sheep
+ bool sheep::wandering() const {
+     return this->escapeState_ != boosted &&
+         (this->properties_[1] != "male" || this->reproductionTimer_.active());
+ };
 
- movingObject::~movingObject() {};
+ void sheep::turn() {
+     if (std::rand() % 2 == 0) {
+         this->vit_x_ *= -1;
+         if (std::rand() % 200 == 0) {
+             this->vit_y_ *= -1;
+         }
+     }
+     else {
+         this->vit_y_ *= -1;
+         if (std::rand() % 200 == 0) {
+             this->vit_x_ *= -1;
+         }
+     }
+ };
 
- void movingObject::verifPosition() {
-     if (pos_x_ <= frame_boundary) {
-         vit_x_ = std::abs(vit_x_);
-         pos_x_ = frame_boundary;
+ void sheep::newSpeed() {
+     if (this->vit_x_ >= 0) {
+         this->vit_x_ = std::rand() % 40;
      }
-     else if (pos_x_ >= frame_width - frame_boundary) {
-         vit_x_ = -std::abs(vit_x_);
-         pos_x_ = frame_width - frame_boundary;
+     else {
+         this->vit_x_ = -std::rand() % 40;
      }
 
-     if (pos_y_ <= frame_boundary) {
-         vit_y_ = std::abs(vit_y_);
-         pos_y_ = frame_boundary;
+     if (this->vit_y_ >= 0) {
+         this->vit_y_ = 40 - std::abs(this->vit_x_);
      }
-     else if (pos_y_ >= frame_height - frame_boundary) {
-         vit_y_ = -std::abs(vit_y_);
-         pos_y_ = frame_height - frame_boundary;
+     else {
+         this->vit_y_ = -40 + std::abs(this->vit_x_);
      }
  };
 
- int movingObject::getVit_x() const { return this->vit_x_; };
- int movingObject::getVit_y() const { return this->vit_y_; };
-
- void movingObject::setVit_x(int vit_x) { this->vit_x_ = vit_x; };
- void movingObject::setVit_y(int vit_y) { this->vit_y_ = vit_y; };
-
- interactiveObject::interactiveObject(const std::string& file_path,
-     SDL_Surface* window_surface_ptr, int pos_x,
-     int pos_y, int vit_x, int vit_y)
-     : movingObject(file_path, window_surface_ptr, pos_x, pos_y, vit_x, vit_y) {};
+ namespace {
+ // Moves until an event with a chance of 1 in odds per move happens, the
+ // same law as drawing std::rand() % odds == 0 at every move
+ unsigned long long randomMoves(int odds) {
+     double u = (std::rand() + 1.0) / (RAND_MAX + 1.0);
+     return 1 + (unsigned long long)(log(u) / log(1.0 - 1.0 / odds));
+ }
 
- interactiveObject::~interactiveObject() {};
+ // Moves until verifPosition() stops the path at a wall, at least 1
+ unsigned long long wallMoves(int pos, int step, int extent) {
+     if (step == 0) {
+         return ULLONG_MAX / 2;
+     }
+     int room = step < 0 ? pos - frame_boundary : extent - frame_boundary - pos;
+     int speed = std::abs(step);
+     return std::max(1, (room + speed - 1) / speed);
+ }
+ }
 
- std::vector<std::string>& interactiveObject::getProperties() {
-     return this->properties_;
+ void sheep::settle(unsigned long long tick) {
+     long long moves = (long long)(tick - this->plan_tick_);
+     this->pos_x_ = this->plan_x_ + (int)(moves * this->step_x_);
+     this->pos_y_ = this->plan_y_ + (int)(moves * this->step_y_);
  };
 
- sheperd::sheperd(SDL_Surface* window_surface_ptr)
-     : interactiveObject("sheperd.png", window_surface_ptr, 0, 0, 0, 0) {
-     pos_x_ = frame_boundary + std::rand() % (frame_width - 2 * frame_boundary);
-     pos_y_ = frame_boundary + std::rand() % (frame_height - 2 * frame_boundary);
-     this->properties_.push_back("sheperd");
-     this->properties_.push_back("male");
-     this->properties_.push_back("0");
-     this->properties_.push_back("alive");
-     this->properties_.push_back("none");
-     this->properties_.push_back("false");
+ void sheep::syncPosition() {
+     if (this->planned_) {
+         this->settle(this->timers_->now());
+     }
  };
 
- sheperd::~sheperd() {};
+ // Starts a path from the move just made. The step of a move is what
+ // pos_x_ += frame_time * vit_x_ adds, the position never being negative.
+ void sheep::plan() {
+     if (!this->timers_) {
+         return;
+     }
+     unsigned long long now = this->timers_->now();
+     this->planned_ = true;
+     this->plan_tick_ = now;
+     this->plan_x_ = this->pos_x_;
+     this->plan_y_ = this->pos_y_;
+     this->step_x_ = (int)floor(frame_time * this->vit_x_);
+     this->step_y_ = (int)floor(frame_time * this->vit_y_);
+     this->next_turn_ = now + randomMoves(200);
+     this->next_speed_ = now + randomMoves(50);
+     unsigned long long next = std::min({ this->next_turn_, this->next_speed_,
+         now + wallMoves(this->plan_x_, this->step_x_, world_width_),
+         now + wallMoves(this->plan_y_, this->step_y_, world_height_) });
+     this->timers_->schedule(this->motionTimer_, (unsigned)(next - now));
+     // The saved state follows the path until the next event
+     this->previous_.pos_x = this->plan_x_;
+     this->previous_.pos_y = this->plan_y_;
+     this->previous_.since = now;
+     this->previous_.step_x = this->step_x_;
+     this->previous_.step_y = this->step_y_;
+     this->saveProperties();
+     this->idle_ = true;
+ };
 
- void sheperd::draw() {
-     SDL_Rect rect;
-     rect.x = pos_x_;
-     rect.y = pos_y_;
-     rect.w = image_ptr_->w;
-     rect.h = image_ptr_->h;
-     SDL_BlitScaled(image_ptr_, NULL, window_surface_ptr_, &rect);
+ // Back to a move at every tick, from the last move made
+ void sheep::unplan() {
+     unsigned long long now = this->timers_->now();
+     this->settle(std::max(this->plan_tick_, now - 1));
+     this->timers_->cancel(this->motionTimer_);
+     this->planned_ = false;
+     this->idle_ = false;
  };
 
- void sheperd::move() {
+ // Makes the move of this tick with the changes due, then the next path
+ void sheep::motionEvent() {
+     unsigned long long now = this->timers_->now();
+     bool turn = now == this->next_turn_;
+     bool speed = now == this->next_speed_;
+     bool idle = this->idle_;
+     this->unplan();
+     if (this->escape_ || !this->wandering()) {
+         // move() takes over, now when integrate() does not move the sheep
+         if (idle) {
+             this->move();
+         }
+         return;
+     }
+     if (turn) {
+         this->turn();
+     }
+     if (speed) {
+         this->newSpeed();
+     }
      pos_x_ += (frame_time * vit_x_);
      pos_y_ += (frame_time * vit_y_);
-
      this->verifPosition();
+     this->plan();
  };
 
- bool sheperd::interact(std::shared_ptr<interactiveObject> interObject) {
-
-     return false;
+ const int sheep::getReproductionTimer() {
+     return this->timers_ ? this->timers_->remaining(this->reproductionTimer_) : 0;
  };
 
- animal::animal(const std::string& file_path, SDL_Surface* window_surface_ptr,
-     int pos_x, int pos_y, int vit_x, int vit_y)
-     : interactiveObject(file_path, window_surface_ptr, pos_x, pos_y, vit_x,
-         vit_y) {};
+ // properties_[2] only changes when the cooldown starts and ends. An idle
+ // sheep is not saved at each tick: its saved state is changed with it.
+ void sheep::startReproductionTimer() {
+     this->properties_[2] = std::to_string(reproduction_ticks);
+     if (this->idle_) {
+         this->previous_.properties[2] = this->properties_[2];
+     }
+     if (this->timers_) {
+         this->timers_->schedule(this->reproductionTimer_, reproduction_ticks);
+     }
+ };
 
- animal::animal(const std::string& file_path, SDL_Surface* window_surface_ptr)
-     : interactiveObject(file_path, window_surface_ptr, 0, 0, 0, 0) {};
+ // A male stops wandering: integrate() does not move him during this tick,
+ // move() leaves the path
+ void sheep::reproductionOver() {
+     this->properties_[2] = "0";
+     if (this->idle_) {
+         this->previous_.properties[2] = this->properties_[2];
+         if (!this->wandering()) {
+             this->move();
+         }
+     }
+ };
 
- animal::~animal() {};
+ bool sheep::fertile() const { return !this->reproductionTimer_.active(); };
 
- void animal::draw() {
-     SDL_Rect rect;
-     rect.x = pos_x_;
-     rect.y = pos_y_;
-     rect.w = image_ptr_->w;
-     rect.h = image_ptr_->h;
-     SDL_BlitScaled(image_ptr_, NULL, window_surface_ptr_, &rect);
- };
 
- sheep::sheep(SDL_Surface* window_surface_ptr, int pos_x, int pos_y, int vit_x,
-     int vit_y, std::string couleur)
-     : animal("sheep.png", window_surface_ptr, pos_x, pos_y, vit_x, vit_y),
-     reproductionTimer_{ 0 }, escapeTimer_{ 0 }, escape_{ false } {
-     this->properties_.push_back("sheep");
-     if (std::rand() % 2 == 0) {
-         this->properties_.push_back("male");
-     }
-     else {
-         this->properties_.push_back("female");
-         this->set_image_ptr("sheep_f.png");
+ bool sheep::reproduit(int pos_sheep_x, int pos_sheep_y) {
+     unsigned int distLove =
+         distance(pos_sheep_x, pos_sheep_y, this->pos_x_, this->pos_y_);
+     if (!this->reproductionTimer_.active() && distLove < 30) {
+         return true;
      }
-     this->properties_.push_back("0");
-     this->properties_.push_back("alive");
+     else if (!this->reproductionTimer_.active()) {
+         int distx =
+             std::abs(pos_sheep_x - this->pos_x_);
+         int disty =
+             std::abs(pos_sheep_y - this->pos_y_);
+         this->vit_x_ = 40 * (sqrt((double)distLove * distLove - (double)disty * disty) / distLove);
 
-     if (couleur != "none") {
-         if (couleur == "pink") {
-             this->properties_.push_back("pink");
-             if (this->getProperties()[1] == "male") {
-                 this->set_image_ptr("sheep_pink.png");
-             }
-             else {
-                 this->set_image_ptr("sheep_f_pink.png");
-             }
-         }
-         else if (couleur == "orange") {
-             this->properties_.push_back("orange");
-             if (this->getProperties()[1] == "male") {
-                 this->set_image_ptr("sheep_orange.png");
-             }
-             else {
-                 this->set_image_ptr("sheep_f_orange.png");
-             }
-         }
-         else if (couleur == "purple") {
-             this->properties_.push_back("purple");
-             if (this->getProperties()[1] == "male") {
-                 this->set_image_ptr("sheep_purple.png");
-             }
-             else {
-                 this->set_image_ptr("sheep_f_purple.png");
-             }
-         }
-         else if (couleur == "green") {
-             this->properties_.push_back("green");
-             if (this->getProperties()[1] == "male") {
-                 this->set_image_ptr("sheep_green.png");
-             }
-             else {
-                 this->set_image_ptr("sheep_f_green.png");
-             }
-         }
-         else if (couleur == "blue") {
-             this->properties_.push_back("blue");
-             if (this->getProperties()[1] == "male") {
-                 this->set_image_ptr("sheep_blue.png");
-             }
-             else {
-                 this->set_image_ptr("sheep_f_blue.png");
-             }
+         this->vit_y_ = 40 - this->vit_x_;
+
+         if ((this->pos_x_ - pos_sheep_x) > 0) {
+             this->vit_x_ = -this->vit_x_;
          }
-         else if (couleur == "red") {
-             this->properties_.push_back("red");
-             if (this->getProperties()[1] == "male") {
-                 this->set_image_ptr("sheep_red.png");
-             }
-             else {
-                 this->set_image_ptr("sheep_f_red.png");
-             }
+         if ((this->pos_y_ - pos_sheep_y) > 0) {
+             this->vit_y_ = -this->vit_y_;
          }
-         else if (couleur == "yellow") {
-             this->properties_.push_back("yellow");
-             if (this->getProperties()[1] == "male") {
-                 this->set_image_ptr("sheep_yellow.png");
-             }
-             else {
-                 this->set_image_ptr("sheep_f_yellow.png");
-             }
+         return false;
+     }
+     return false;
+ };
+
+ bool sheep::escape(int pos_wolf_x, int pos_wolf_y) {
+     // Off its path: integrate() moves it again from this tick
+     if (this->idle_) {
+         this->syncPosition();
+         this->idle_ = false;
+     }
+
+     this->escape_ = true;
+     int distLoup =
+         distance(pos_wolf_x, pos_wolf_y, this->pos_x_, this->pos_y_);
+
+     if (this->escapeState_ == calm) {
+         int distx = std::abs(pos_wolf_x - this->pos_x_);
+         int disty = std::abs(pos_wolf_y - this->pos_y_);
+         this->vit_x_ = 80 * (sqrt((double)distLoup * distLoup - (double)disty * disty) / distLoup);
+
+         this->vit_y_ = 80 - this->vit_x_;
+
+         if ((this->pos_x_ - pos_wolf_x) < 0) {
+             this->vit_x_ = -this->vit_x_;
          }
-         else if (couleur == "white") {
-             this->properties_.push_back("white");
+         if ((this->pos_y_ - pos_wolf_y) < 0) {
+             this->vit_y_ = -this->vit_y_;
          }
 
+         this->escapeState_ = boosted;
+
      }
      else {
-         int r = rand() % 4;
-         if (r == 0) {
-             this->properties_.push_back("red");
-             if (this->getProperties()[1] == "male") {
-                 this->set_image_ptr("sheep_red.png");
-             }
-             else {
-                 this->set_image_ptr("sheep_f_red.png");
-             }
-         }
-         else if (r == 1) {
-             this->properties_.push_back("blue");
-             if (this->getProperties()[1] == "male") {
-                 this->set_image_ptr("sheep_blue.png");
-             }
-             else {
-                 this->set_image_ptr("sheep_f_blue.png");
-             }
-         }
-         else if (r == 2) {
-             this->properties_.push_back("yellow");
-             if (this->getProperties()[1] == "male") {
-                 this->set_image_ptr("sheep_yellow.png");
-             }
-             else {
-                 this->set_image_ptr("sheep_f_yellow.png");
-             }
+         int distx = std::abs(pos_wolf_x - this->pos_x_);
+         int disty = std::abs(pos_wolf_y - this->pos_y_);
+         this->vit_x_ = 40 * (sqrt((double)distLoup * distLoup - (double)disty * disty) / distLoup);
+
+         this->vit_y_ = 40 - this->vit_x_;
+
+         if ((this->pos_x_ - pos_wolf_x) < 0) {
+             this->vit_x_ = -this->vit_x_;
          }
-         else {
-             this->properties_.push_back("white");
+         if ((this->pos_y_ - pos_wolf_y) < 0) {
+             this->vit_y_ = -this->vit_y_;
          }
      }
-     this->properties_.push_back("false");
- }
 
- sheep::sheep(SDL_Surface* window_surface_ptr)
-     : sheep(window_surface_ptr, 0, 0, 0, 0, "none") {
-     pos_x_ = frame_boundary + std::rand() % (frame_width - 2 * frame_boundary);
-     pos_y_ = frame_boundary + std::rand() % (frame_height - 2 * frame_boundary);
+     return true;
+ };
 
+ wolf::wolf()
+     : animal("wolf.png"), chasse_{ false } {
+     pos_x_ = randomIn(frame_boundary, world_width_ - frame_boundary);
+     pos_y_ = randomIn(frame_boundary, world_height_ - frame_boundary);
      if (std::rand() % 2 == 0) {
-         vit_x_ = -20;
+         vit_x_ = -40;
      }
      else {
-         vit_x_ = 20;
+         vit_x_ = 40;
      }
      if (std::rand() % 2 == 0) {
-         vit_y_ = -20;
+         vit_y_ = -40;
      }
      else {
-         vit_y_ = 20;
+         vit_y_ = 40;
+     }
+
+     this->properties_.push_back("wolf");
+     if (std::rand() % 2 == 0) {
+         this->properties_.push_back("male");
+     }
+     else {
+         this->properties_.push_back("female");
      }
+     this->properties_.push_back("0");
+     this->properties_.push_back("alive");
+     this->properties_.push_back("none");
+     this->properties_.push_back("false");
  };
 
- sheep::~sheep() {};
+ wolf::~wolf() {};
 
- void sheep::move() {
+ void wolf::move() {
 
-     if (this->escapeTimer_ != 0) {
-         this->escapeTimer_--;
-     }
-     if (this->reproductionTimer_ != 0) {
-         this->reproductionTimer_ = std::stoi(this->properties_[2]);
-         this->reproductionTimer_--;
-         this->properties_[2] = std::to_string(reproductionTimer_);
-     }
+     this->updateEscape();
 
-     if (!escape_ &&
-         (this->properties_[1] != "male" ||
-             (this->properties_[1] == "male" && reproductionTimer_ != 0))) {
-         if (this->escapeTimer_ == 500) {
+     if (!chasse_ && !escape_) {
+         if (this->boostEnded_) {
              if (this->vit_x_ >= 0) {
-                 this->vit_x_ = std::rand() % 40;
+                 this->vit_x_ = std::rand() % 80;
              }
              else {
-                 this->vit_x_ = -std::rand() % 40;
+                 this->vit_x_ = -std::rand() % 80;
              }
 
              if (this->vit_y_ >= 0) {
-                 this->vit_y_ = 40 - std::abs(this->vit_x_);
+                 this->vit_y_ = 80 - std::abs(this->vit_x_);
              }
              else {
-                 this->vit_y_ = -40 + std::abs(this->vit_x_);
+                 this->vit_y_ = -80 + std::abs(this->vit_x_);
              }
          }
-         else if (this->escapeTimer_ < 500) {
-             if (std::rand() % 200 == 0) {
+         else if (this->escapeState_ != boosted) {
+             if (std::rand() % 150 == 0) {
                  if (std::rand() % 2 == 0) {
                      this->vit_x_ *= -1;
-                     if (std::rand() % 200 == 0) {
+                     if (std::rand() % 150 == 0) {
                          this->vit_y_ *= -1;
                      }
                  }
                  else {
                      this->vit_y_ *= -1;
-                     if (std::rand() % 200 == 0) {
+                     if (std::rand() % 150 == 0) {
                          this->vit_x_ *= -1;
                      }
                  }
@@ -347,74 +1882,49 @@ void init() {
 
              if (std::rand() % 50 == 0) {
                  if (this->vit_x_ >= 0) {
-                     this->vit_x_ = std::rand() % 40;
+                     this->vit_x_ = std::rand() % 80;
                  }
                  else {
-                     this->vit_x_ = -std::rand() % 40;
+                     this->vit_x_ = -std::rand() % 80;
                  }
 
                  if (this->vit_y_ >= 0) {
-                     this->vit_y_ = 40 - std::abs(this->vit_x_);
+                     this->vit_y_ = 80 - std::abs(this->vit_x_);
                  }
                  else {
-                     this->vit_y_ = -40 + std::abs(this->vit_x_);
+                     this->vit_y_ = -80 + std::abs(this->vit_x_);
                  }
              }
          }
      }
 
+     this->escape_ = false;
+     this->boostEnded_ = false;
+     this->chasse_ = false;
+
      pos_x_ += (frame_time * vit_x_);
      pos_y_ += (frame_time * vit_y_);
 
-     this->escape_ = false;
-
      this->verifPosition();
  };
 
- const int sheep::getReproductionTimer() { return this->reproductionTimer_; };
-
- void sheep::setReproductionTimer(int newTime) {
-     this->reproductionTimer_ = newTime;
- };
-
- bool sheep::interact(std::shared_ptr<interactiveObject> interObject) {
-     if (interObject->getProperties()[0] == "zombie") {
-         return this->escape(interObject->get_pos_x(), interObject->get_pos_y());
-     }
-     else if (interObject->getProperties()[0] == "wolf") {
-         return this->escape(interObject->get_pos_x(), interObject->get_pos_y());
-     }
-     else if (interObject->getProperties()[0] == "sheep" &&
-         this->getProperties()[1] == "male") {
-         if ((interObject->getProperties()[2] == "0") &&
-             this->reproduit(interObject->get_pos_x(), interObject->get_pos_y())) {
-             interObject->getProperties()[2] = "1000";
-             this->properties_[2] = "1000";
-             return true;
-         }
-         else {
-             return false;
-         }
-     }
-     return false;
- };
+ bool wolf::croque(int pos_sheep_x, int pos_sheep_y) {
+     unsigned int distMout =
+         distance(pos_sheep_x, pos_sheep_y, this->pos_x_, this->pos_y_);
 
- bool sheep::reproduit(int pos_sheep_x, int pos_sheep_y) {
-     unsigned int distLove =
-         sqrt(((pos_sheep_x - this->pos_x_) * (pos_sheep_x - this->pos_x_)) +
-             ((pos_sheep_y - this->pos_y_) * (pos_sheep_y - this->pos_y_)));
-     if (this->reproductionTimer_ == 0 && distLove < 30) {
-         this->reproductionTimer_ = 1000;
+     if (distMout < 50) {
+         this->pos_x_ = pos_sheep_x;
+         this->pos_y_ = pos_sheep_y;
          return true;
      }
-     else if (this->reproductionTimer_ == 0) {
+     else {
          int distx =
-             sqrt((pos_sheep_x - this->pos_x_) * (pos_sheep_x - this->pos_x_));
+             std::abs(pos_sheep_x - this->pos_x_);
          int disty =
-             sqrt((pos_sheep_y - this->pos_y_) * (pos_sheep_y - this->pos_y_));
-         this->vit_x_ = 40 * (sqrt(distLove * distLove - disty * disty) / distLove);
+             std::abs(pos_sheep_y - this->pos_y_);
+         this->vit_x_ = 80 * (sqrt((double)distMout * distMout - (double)disty * disty) / distMout);
 
-         this->vit_y_ = 40 - this->vit_x_;
+         this->vit_y_ = 80 - this->vit_x_;
 
          if ((this->pos_x_ - pos_sheep_x) > 0) {
              this->vit_x_ = -this->vit_x_;
@@ -422,46 +1932,45 @@ void init() {
          if ((this->pos_y_ - pos_sheep_y) > 0) {
              this->vit_y_ = -this->vit_y_;
          }
-         return false;
      }
+
+     this->chasse_ = true;
+
      return false;
  };
 
- bool sheep::escape(int pos_wolf_x, int pos_wolf_y) {
-
+ bool wolf::escape(int pos_dog_x, int pos_dog_y) {
      this->escape_ = true;
-     int distLoup =
-         sqrt(((pos_wolf_x - this->pos_x_) * (pos_wolf_x - this->pos_x_)) +
-             ((pos_wolf_y - this->pos_y_) * (pos_wolf_y - this->pos_y_)));
+     int distDog = distance(pos_dog_x, pos_dog_y, this->pos_x_, this->pos_y_);
 
-     if (this->escapeTimer_ == 0) {
-         int distx = sqrt((pos_wolf_x - this->pos_x_) * (pos_wolf_x - this->pos_x_));
-         int disty = sqrt((pos_wolf_y - this->pos_y_) * (pos_wolf_y - this->pos_y_));
-         this->vit_x_ = 80 * (sqrt(distLoup * distLoup - disty * disty) / distLoup);
+     if (this->escapeState_ == calm) {
+         int distx = std::abs(pos_dog_x - this->pos_x_);
+         int disty = std::abs(pos_dog_y - this->pos_y_);
+         this->vit_x_ = 100 * (sqrt((double)distDog * distDog - (double)disty * disty) / distDog);
 
-         this->vit_y_ = 80 - this->vit_x_;
+         this->vit_y_ = 100 - this->vit_x_;
 
-         if ((this->pos_x_ - pos_wolf_x) < 0) {
+         if ((this->pos_x_ - pos_dog_x) < 0) {
              this->vit_x_ = -this->vit_x_;
          }
-         if ((this->pos_y_ - pos_wolf_y) < 0) {
+         if ((this->pos_y_ - pos_dog_y) < 0) {
              this->vit_y_ = -this->vit_y_;
          }
 
-         this->escapeTimer_ = 1000;
+         this->escapeState_ = boosted;
 
      }
      else {
-         int distx = sqrt((pos_wolf_x - this->pos_x_) * (pos_wolf_x - this->pos_x_));
-         int disty = sqrt((pos_wolf_y - this->pos_y_) * (pos_wolf_y - this->pos_y_));
-         this->vit_x_ = 40 * (sqrt(distLoup * distLoup - disty * disty) / distLoup);
+         int distx = std::abs(pos_dog_x - this->pos_x_);
+         int disty = std::abs(pos_dog_y - this->pos_y_);
+         this->vit_x_ = 80 * (sqrt((double)distDog * distDog - (double)disty * disty) / distDog);
 
-         this->vit_y_ = 40 - this->vit_x_;
+         this->vit_y_ = 80 - this->vit_x_;
 
-         if ((this->pos_x_ - pos_wolf_x) < 0) {
+         if ((this->pos_x_ - pos_dog_x) < 0) {
              this->vit_x_ = -this->vit_x_;
          }
-         if ((this->pos_y_ - pos_wolf_y) < 0) {
+         if ((this->pos_y_ - pos_dog_y) < 0) {
              this->vit_y_ = -this->vit_y_;
          }
      }
@@ -469,10 +1978,15 @@ void init() {
      return true;
  };
 
- wolf::wolf(SDL_Surface* window_surface_ptr)
-     : animal("wolf.png", window_surface_ptr), chasse_{ false } {
-     pos_x_ = frame_boundary + std::rand() % (frame_width - 2 * frame_boundary);
-     pos_y_ = frame_boundary + std::rand() % (frame_height - 2 * frame_boundary);
+ zombie::zombie()
+     : zombie(0,0,0,0){
+     pos_x_ = randomIn(frame_boundary, world_width_ - frame_boundary);
+     pos_y_ = randomIn(frame_boundary, world_height_ - frame_boundary);
+     
+ };
+
+ zombie::zombie(int pos_x, int pos_y, int vit_x, int vit_y)
+     : animal("sheep_z.png", pos_x, pos_y, vit_x, vit_y), chasse_{ false }{
      if (std::rand() % 2 == 0) {
          vit_x_ = -40;
      }
@@ -486,7 +2000,7 @@ void init() {
          vit_y_ = 40;
      }
 
-     this->properties_.push_back("wolf");
+     this->properties_.push_back("zombie");
      if (std::rand() % 2 == 0) {
          this->properties_.push_back("male");
      }
@@ -499,16 +2013,14 @@ void init() {
      this->properties_.push_back("false");
  };
 
- wolf::~wolf() {};
+ zombie::~zombie() {};
 
- void wolf::move() {
+ void zombie::move() {
 
-     if (this->escapeTimer_ != 0) {
-         this->escapeTimer_--;
-     }
+     this->updateEscape();
 
-     if (!chasse_ && !escape_) {
-         if (this->escapeTimer_ == 500) {
+     if (!chasse_ && !escape_ && this->properties_[5] == "false") {
+         if (this->boostEnded_) {
              if (this->vit_x_ >= 0) {
                  this->vit_x_ = std::rand() % 80;
              }
@@ -523,7 +2035,7 @@ void init() {
                  this->vit_y_ = -80 + std::abs(this->vit_x_);
              }
          }
-         else if (this->escapeTimer_ < 500) {
+         else if (this->escapeState_ != boosted) {
              if (std::rand() % 150 == 0) {
                  if (std::rand() % 2 == 0) {
                      this->vit_x_ *= -1;
@@ -558,34 +2070,34 @@ void init() {
      }
 
      this->escape_ = false;
+     this->boostEnded_ = false;
      this->chasse_ = false;
-
+     
      pos_x_ += (frame_time * vit_x_);
      pos_y_ += (frame_time * vit_y_);
 
-     this->verifPosition();
- };
-
- bool wolf::interact(std::shared_ptr<interactiveObject> interObject) {
+     if (this->properties_[5] == "true") {
+         if (this->vit_x_ >= 0) {
+             this->vit_x_ = -std::rand() % 80;
+         }
+         else {
+             this->vit_x_ = std::rand() % 80;
+         }
 
-     if (interObject->getProperties()[0] == "zombie") {
-         return this->escape(interObject->get_pos_x(), interObject->get_pos_y());
-     }
-     else if (interObject->getProperties()[0] == "sheep") {
-         if (this->croque(interObject->get_pos_x(), interObject->get_pos_y())) {
-             interObject->getProperties()[3] = "dead";
-             return true;
+         if (this->vit_y_ >= 0) {
+             this->vit_y_ = -80 - std::abs(this->vit_x_);
          }
+         else {
+             this->vit_y_ = 80 + std::abs(this->vit_x_);
+         }
+         this->properties_[5] = "false";
      }
-     else if (interObject->getProperties()[0] == "dog") {
-         return this->escape(interObject->get_pos_x(), interObject->get_pos_y());
-     }
-     return false;
+
+     this->verifPosition();
  };
- bool wolf::croque(int pos_sheep_x, int pos_sheep_y) {
+ bool zombie::croque(int pos_sheep_x, int pos_sheep_y) {
      unsigned int distMout =
-         sqrt(((pos_sheep_x - this->pos_x_) * (pos_sheep_x - this->pos_x_)) +
-             ((pos_sheep_y - this->pos_y_) * (pos_sheep_y - this->pos_y_)));
+         distance(pos_sheep_x, pos_sheep_y, this->pos_x_, this->pos_y_);
 
      if (distMout < 50) {
          this->pos_x_ = pos_sheep_x;
@@ -594,10 +2106,10 @@ void init() {
      }
      else {
          int distx =
-             sqrt((pos_sheep_x - this->pos_x_) * (pos_sheep_x - this->pos_x_));
+             std::abs(pos_sheep_x - this->pos_x_);
          int disty =
-             sqrt((pos_sheep_y - this->pos_y_) * (pos_sheep_y - this->pos_y_));
-         this->vit_x_ = 80 * (sqrt(distMout * distMout - disty * disty) / distMout);
+             std::abs(pos_sheep_y - this->pos_y_);
+         this->vit_x_ = 80 * (sqrt((double)distMout * distMout - (double)disty * disty) / distMout);
 
          this->vit_y_ = 80 - this->vit_x_;
 
@@ -614,15 +2126,122 @@ void init() {
      return false;
  };
 
- bool wolf::escape(int pos_dog_x, int pos_dog_y) {
+ bool zombie::recule(int pos_sheperd_x, int pos_sheperd_y) {
+     int distSheperd = distance(pos_sheperd_x, pos_sheperd_y, this->pos_x_, this->pos_y_);
+
+     int distx = std::abs(pos_sheperd_x - this->pos_x_);
+     int disty = std::abs(pos_sheperd_y - this->pos_y_);
+     this->vit_x_ = 500 * (sqrt((double)distSheperd * distSheperd - (double)disty * disty) / distSheperd);
+
+     this->vit_y_ = 500 - this->vit_x_;
+
+     if ((this->pos_x_ - pos_sheperd_x) < 0) {
+         this->vit_x_ = -this->vit_x_;
+     }
+     if ((this->pos_y_ - pos_sheperd_y) < 0) {
+         this->vit_y_ = -this->vit_y_;
+     }
+     return true;
+ }
+
+ dog::dog(std::shared_ptr<sheperd> maitre)
+     : animal("dog.png"), maitre_{ maitre }, proche_{ true } {
+     this->pos_x_ = this->maitre_->get_pos_x() + 20;
+     this->pos_y_ = this->maitre_->get_pos_y() + 20;
+
+     this->properties_.push_back("dog");
+     if (std::rand() % 2 == 0) {
+         this->properties_.push_back("male");
+     }
+     else {
+         this->properties_.push_back("female");
+     }
+     this->properties_.push_back("0");
+     this->properties_.push_back("alive");
+     this->properties_.push_back("none");
+     this->properties_.push_back("false");
+ };
+
+ dog::~dog() {};
+
+ void dog::move() {
+
+     if (this->proche_) {
+         if (std::rand() % 150 == 0) {
+             if (std::rand() % 2 == 0) {
+                 this->vit_x_ *= -1;
+                 if (std::rand() % 150 == 0) {
+                     this->vit_y_ *= -1;
+                 }
+             }
+             else {
+                 this->vit_y_ *= -1;
+                 if (std::rand() % 150 == 0) {
+                     this->vit_x_ *= -1;
+                 }
+             }
+         }
+
+         if (std::rand() % 10 == 0) {
+             if (this->vit_x_ >= 0) {
+                 this->vit_x_ = std::rand() % 80;
+             }
+             else {
+                 this->vit_x_ = -std::rand() % 80;
+             }
+
+             if (this->vit_y_ >= 0) {
+                 this->vit_y_ = 100 - std::abs(this->vit_x_);
+             }
+             else {
+                 this->vit_y_ = -100 + std::abs(this->vit_x_);
+             }
+         }
+     }
+
+     pos_x_ += (frame_time * vit_x_);
+     pos_y_ += (frame_time * vit_y_);
+
+     this->proche_ = true;
+
+     this->verifPosition();
+ };
+
+ bool dog::follow(int pos_sheperd_x, int pos_sheperd_y) {
+     int distSheperd = distance(pos_sheperd_x, pos_sheperd_y, this->pos_x_, this->pos_y_);
+     if (distSheperd > 50) {
+         this->proche_ = false;
+
+         int distx = std::abs(pos_sheperd_x - this->pos_x_);
+         int disty = std::abs(pos_sheperd_y - this->pos_y_);
+         this->vit_x_ =
+             180 * (sqrt((double)distSheperd * distSheperd - (double)disty * disty) / distSheperd);
+
+         this->vit_y_ = 180 - this->vit_x_;
+
+         if ((this->pos_x_ - pos_sheperd_x) > 0) {
+             this->vit_x_ = -this->vit_x_;
+         }
+         if ((this->pos_y_ - pos_sheperd_y) > 0) {
+             this->vit_y_ = -this->vit_y_;
+         }
+
+     }
+     else {
+         this->proche_ = true;
+     }
+     return true;
+ };
+
+ bool dog::escape(int pos_dog_x, int pos_dog_y) {
+
      this->escape_ = true;
-     int distDog = sqrt(((pos_dog_x - this->pos_x_) * (pos_dog_x - this->pos_x_)) +
-         ((pos_dog_y - this->pos_y_) * (pos_dog_y - this->pos_y_)));
+     int distDog = distance(pos_dog_x, pos_dog_y, this->pos_x_, this->pos_y_);
 
-     if (this->escapeTimer_ == 0) {
-         int distx = sqrt((pos_dog_x - this->pos_x_) * (pos_dog_x - this->pos_x_));
-         int disty = sqrt((pos_dog_y - this->pos_y_) * (pos_dog_y - this->pos_y_));
-         this->vit_x_ = 100 * (sqrt(distDog * distDog - disty * disty) / distDog);
+     if (this->escapeState_ == calm) {
+         int distx = std::abs(pos_dog_x - this->pos_x_);
+         int disty = std::abs(pos_dog_y - this->pos_y_);
+         this->vit_x_ = 100 * (sqrt((double)distDog * distDog - (double)disty * disty) / distDog);
 
          this->vit_y_ = 100 - this->vit_x_;
 
@@ -633,13 +2252,13 @@ void init() {
              this->vit_y_ = -this->vit_y_;
          }
 
-         this->escapeTimer_ = 1000;
+         this->escapeState_ = boosted;
 
      }
      else {
-         int distx = sqrt((pos_dog_x - this->pos_x_) * (pos_dog_x - this->pos_x_));
-         int disty = sqrt((pos_dog_y - this->pos_y_) * (pos_dog_y - this->pos_y_));
-         this->vit_x_ = 80 * (sqrt(distDog * distDog - disty * disty) / distDog);
+         int distx = std::abs(pos_dog_x - this->pos_x_);
+         int disty = std::abs(pos_dog_y - this->pos_y_);
+         this->vit_x_ = 80 * (sqrt((double)distDog * distDog - (double)disty * disty) / distDog);
 
          this->vit_y_ = 80 - this->vit_x_;
 
@@ -654,806 +2273,2032 @@ void init() {
      return true;
  };
 
- zombie::zombie(SDL_Surface* window_surface_ptr)
-     : zombie(window_surface_ptr,0,0,0,0){
-     pos_x_ = frame_boundary + std::rand() % (frame_width - 2 * frame_boundary);
-     pos_y_ = frame_boundary + std::rand() % (frame_height - 2 * frame_boundary);
-     
+ taskGraph::taskGraph() : runs_{ 0 }, total_span_ms_{ 0. } {};
+
+ int taskGraph::add(const std::string& name, std::function<void()> work,
+     std::vector<int> after) {
+     int id = (int)this->tasks_.size();
+     for (int before : after) {
+         if (before < 0 || before >= id)
+             throw std::runtime_error("taskGraph::add(): " + name +
+                 " depends on a task added after it");
+         this->tasks_[before].dependents.push_back(id);
+     }
+     task new_task;
+     new_task.name = name;
+     new_task.work = std::move(work);
+     new_task.after = std::move(after);
+     this->tasks_.push_back(std::move(new_task));
+     return id;
+ };
+
+ int taskGraph::addParallel(const std::string& name, unsigned chunks,
+     std::function<void(unsigned, unsigned)> work, std::vector<int> after) {
+     std::vector<int> parts;
+     for (unsigned chunk = 0; chunk < chunks; chunk++) {
+         parts.push_back(this->add(name, [work, chunk, chunks] { work(chunk, chunks); },
+             after));
+     }
+     return this->add(name + " join", [] {}, parts);
+ };
+
+ size_t taskGraph::size() const { return this->tasks_.size(); };
+
+ taskGraph::task& taskGraph::at(int id) { return this->tasks_[id]; };
+
+ void taskGraph::finishRun() {
+     if (this->tasks_.empty()) {
+         return;
+     }
+     double frequency = (double)SDL_GetPerformanceFrequency();
+     Uint64 first = this->tasks_[0].start;
+     Uint64 last = this->tasks_[0].end;
+     for (auto& a_task : this->tasks_) {
+         a_task.total_ms += 1000. * (a_task.end - a_task.start) / frequency;
+         first = std::min(first, a_task.start);
+         last = std::max(last, a_task.end);
+     }
+     this->total_span_ms_ += 1000. * (last - first) / frequency;
+     this->runs_++;
+ };
+
+ // Mean duration of every task, and the chain of tasks that bounds the
+ // duration of a run whatever the number of threads (critical path)
+ void taskGraph::report() const {
+     if (this->runs_ == 0) {
+         return;
+     }
+     // Tasks of a parallel group share their name, they are shown once
+     std::map<std::string, double> per_name;
+     for (const auto& a_task : this->tasks_) {
+         per_name[a_task.name] += a_task.total_ms / this->runs_;
+     }
+     std::vector<double> finish(this->tasks_.size(), 0.);
+     std::vector<int> previous(this->tasks_.size(), -1);
+     int last = 0;
+     double work = 0.;
+     for (size_t id = 0; id < this->tasks_.size(); id++) {
+         double start = 0.;
+         for (int before : this->tasks_[id].after) {
+             if (finish[before] > start) {
+                 start = finish[before];
+                 previous[id] = before;
+             }
+         }
+         double duration = this->tasks_[id].total_ms / this->runs_;
+         finish[id] = start + duration;
+         work += duration;
+         if (finish[id] > finish[last]) {
+             last = (int)id;
+         }
+     }
+     std::vector<std::string> path;
+     for (int id = last; id >= 0; id = previous[id]) {
+         path.push_back(this->tasks_[id].name);
+     }
+
+     std::cout << "Task graph over " << this->runs_ << " runs, mean "
+         << this->total_span_ms_ / this->runs_ << " ms, work " << work
+         << " ms" << std::endl;
+     for (const auto& task_time : per_name) {
+         std::cout << "  " << task_time.first << " : " << task_time.second
+             << " ms" << std::endl;
+     }
+     std::cout << "  critical path (" << finish[last] << " ms) :";
+     for (auto name = path.rbegin(); name != path.rend(); name++) {
+         std::cout << (name == path.rbegin() ? " " : " -> ") << *name;
+     }
+     std::cout << std::endl;
+ };
+
+ taskExecutor::taskExecutor(unsigned workers)
+     : graph_{ nullptr }, remaining_{ 0 }, quit_{ false } {
+     for (unsigned i = 0; i < workers; i++) {
+         this->workers_.emplace_back(&taskExecutor::workerLoop, this);
+     }
+ };
+
+ taskExecutor::~taskExecutor() {
+     {
+         std::lock_guard<std::mutex> lock(this->mutex_);
+         this->quit_ = true;
+     }
+     this->changed_.notify_all();
+     for (auto& worker : this->workers_) {
+         worker.join();
+     }
+ };
+
+ unsigned taskExecutor::size() const { return (unsigned)this->workers_.size() + 1; };
+
+ void taskExecutor::workerLoop() {
+     std::unique_lock<std::mutex> lock(this->mutex_);
+     while (true) {
+         this->changed_.wait(lock, [this] { return this->quit_ || !this->ready_.empty(); });
+         if (this->quit_) {
+             return;
+         }
+         this->runOne(lock);
+     }
+ };
+
+ // Runs one ready task with the lock released, then releases the tasks
+ // waiting for it. False when no task was ready.
+ bool taskExecutor::runOne(std::unique_lock<std::mutex>& lock) {
+     if (this->ready_.empty()) {
+         return false;
+     }
+     int id = this->ready_.back();
+     this->ready_.pop_back();
+     taskGraph::task& a_task = this->graph_->at(id);
+
+     lock.unlock();
+     a_task.start = SDL_GetPerformanceCounter();
+     try {
+         a_task.work();
+     }
+     catch (...) {
+         lock.lock();
+         if (!this->error_) {
+             this->error_ = std::current_exception();
+         }
+         lock.unlock();
+     }
+     a_task.end = SDL_GetPerformanceCounter();
+     lock.lock();
+
+     bool released = false;
+     for (int dependent : a_task.dependents) {
+         if (--this->pending_[dependent] == 0) {
+             this->ready_.push_back(dependent);
+             released = true;
+         }
+     }
+     if (--this->remaining_ == 0) {
+         this->graph_->finishRun();
+         this->graph_ = nullptr;
+         this->changed_.notify_all();
+     }
+     else if (released) {
+         this->changed_.notify_all();
+     }
+     return true;
+ };
+
+ void taskExecutor::start(taskGraph& graph) {
+     std::lock_guard<std::mutex> lock(this->mutex_);
+     if (this->graph_)
+         throw std::runtime_error("taskExecutor::start(): a graph is already running");
+     if (graph.size() == 0) {
+         return;
+     }
+     this->graph_ = &graph;
+     this->remaining_ = graph.size();
+     this->pending_.assign(graph.size(), 0);
+     this->ready_.clear();
+     for (size_t id = 0; id < graph.size(); id++) {
+         this->pending_[id] = (int)graph.at((int)id).after.size();
+         if (this->pending_[id] == 0) {
+             this->ready_.push_back((int)id);
+         }
+     }
+     this->changed_.notify_all();
+ };
+
+ void taskExecutor::wait() {
+     std::unique_lock<std::mutex> lock(this->mutex_);
+     while (this->graph_) {
+         if (!this->runOne(lock)) {
+             this->changed_.wait(lock);
+         }
+     }
+     if (this->error_) {
+         std::exception_ptr error = this->error_;
+         this->error_ = nullptr;
+         std::rethrow_exception(error);
+     }
+ };
+
+ void taskExecutor::run(taskGraph& graph) {
+     this->start(graph);
+     this->wait();
+ };
+
+ spatialGrid::spatialGrid(int cell_size, int width, int height)
+     : cell_size_{ cell_size }, columns_{ width / cell_size + 1 },
+     rows_{ height / cell_size + 1 } {
+     this->starts_.assign(1, 0);
+ };
+
+ int spatialGrid::column(int x) const {
+     return std::clamp(x / this->cell_size_, 0, this->columns_ - 1);
+ };
+
+ int spatialGrid::row(int y) const {
+     return std::clamp(y / this->cell_size_, 0, this->rows_ - 1);
+ };
+
+ int spatialGrid::lowerCell(long long key) const {
+     return (int)(std::lower_bound(this->keys_.begin(), this->keys_.end(), key) -
+         this->keys_.begin());
+ };
+
+ int spatialGrid::firstCell(size_t entry) const {
+     return (int)(std::lower_bound(this->starts_.begin(), this->starts_.end() - 1,
+         (int)entry) - this->starts_.begin());
+ };
+
+ void spatialGrid::reserve(size_t objects) {
+     this->cell_of_.reserve(objects);
+     this->indices_.reserve(objects);
+     this->keys_.reserve(objects);
+     this->starts_.reserve(objects + 1);
+ };
+
+ // Sort of the animals by cell, by index within a cell
+ void spatialGrid::build(
+     const std::vector<std::shared_ptr<interactiveObject>>& objects,
+     unsigned long long tick) {
+     this->cell_of_.resize(objects.size());
+     this->indices_.resize(objects.size());
+     for (size_t i = 0; i < objects.size(); i++) {
+         const entityState& state = objects[i]->getPrevious();
+         this->cell_of_[i] = key(row(state.y(tick)), column(state.x(tick)));
+         this->indices_[i] = (int)i;
+     }
+     std::sort(this->indices_.begin(), this->indices_.end(), [this](int a, int b) {
+         return this->cell_of_[a] < this->cell_of_[b] ||
+             (this->cell_of_[a] == this->cell_of_[b] && a < b);
+     });
+     this->keys_.clear();
+     this->starts_.clear();
+     for (size_t entry = 0; entry < this->indices_.size(); entry++) {
+         long long cell = this->cell_of_[this->indices_[entry]];
+         if (this->keys_.empty() || this->keys_.back() != cell) {
+             this->keys_.push_back(cell);
+             this->starts_.push_back((int)entry);
+         }
+     }
+     this->starts_.push_back((int)this->indices_.size());
+ };
+
+ herdIndex::herdIndex()
+     : ticks_{ 0 }, strays_{ 0 }, searches_{ 0 }, searched_{ 0 } {};
+
+ void herdIndex::reserve(size_t objects) {
+     this->herds_.reserve(objects);
+     this->free_.reserve(objects);
+     this->herd_of_.reserve(objects);
+     this->starts_.reserve(objects + 1);
+     this->members_.reserve(objects);
+     this->next_.reserve(objects);
+ };
+
+ int herdIndex::join(int x, int y) const {
+     long long best = (long long)join_radius * join_radius;
+     int joined = -1;
+     for (size_t h = 0; h < this->herds_.size(); h++) {
+         long long dx = this->herds_[h].x - x;
+         long long dy = this->herds_[h].y - y;
+         if (this->herds_[h].used && dx * dx + dy * dy <= best) {
+             best = dx * dx + dy * dy;
+             joined = (int)h;
+         }
+     }
+     return joined;
+ };
+
+ long long herdIndex::lowerBound(const herd& a_herd, int x, int y) {
+     long long dx = a_herd.x - x;
+     long long dy = a_herd.y - y;
+     long long gap = (long long)sqrt((double)(dx * dx + dy * dy)) - a_herd.radius;
+     return gap > 0 ? gap * gap : 0;
+ };
+
+ // The sheep stay in their herd while they are close to the centre of the
+ // last tick, the others join the nearest herd around or start one. The
+ // herds left without members are reused.
+ void herdIndex::update(
+     const std::vector<std::shared_ptr<interactiveObject>>& objects,
+     unsigned long long tick) {
+     this->ticks_++;
+     for (auto& a_herd : this->herds_) {
+         a_herd.sum_x = 0;
+         a_herd.sum_y = 0;
+         a_herd.count = 0;
+     }
+     this->herd_of_.assign(objects.size(), -1);
+     for (size_t i = 0; i < objects.size(); i++) {
+         const entityState& state = objects[i]->getPrevious();
+         if (state.kind != species::sheep) {
+             continue;
+         }
+         int x = state.x(tick);
+         int y = state.y(tick);
+         int h = objects[i]->getHerd();
+         bool stays = false;
+         if (h >= 0 && h < (int)this->herds_.size() && this->herds_[h].used) {
+             long long dx = this->herds_[h].x - x;
+             long long dy = this->herds_[h].y - y;
+             stays = dx * dx + dy * dy <= (long long)join_radius * join_radius;
+         }
+         if (!stays) {
+             h = this->join(x, y);
+             if (h < 0) {
+                 if (this->free_.empty()) {
+                     h = (int)this->herds_.size();
+                     this->herds_.push_back({});
+                 }
+                 else {
+                     h = this->free_.back();
+                     this->free_.pop_back();
+                 }
+                 this->herds_[h] = { 0, 0, 0, x, y, 0, true };
+             }
+             objects[i]->setHerd(h);
+             this->strays_++;
+         }
+         this->herds_[h].sum_x += x;
+         this->herds_[h].sum_y += y;
+         this->herds_[h].count++;
+         this->herd_of_[i] = h;
+     }
+     for (size_t h = 0; h < this->herds_.size(); h++) {
+         herd& a_herd = this->herds_[h];
+         if (a_herd.used && a_herd.count == 0) {
+             a_herd.used = false;
+             this->free_.push_back((int)h);
+         }
+         else if (a_herd.used) {
+             a_herd.x = (int)(a_herd.sum_x / a_herd.count);
+             a_herd.y = (int)(a_herd.sum_y / a_herd.count);
+             a_herd.radius = 0;
+         }
+     }
+     // Members by herd, counting sort as in the grid
+     this->starts_.assign(this->herds_.size() + 1, 0);
+     for (int h : this->herd_of_) {
+         if (h >= 0) {
+             this->starts_[h + 1]++;
+         }
+     }
+     for (size_t h = 1; h < this->starts_.size(); h++) {
+         this->starts_[h] += this->starts_[h - 1];
+     }
+     this->members_.resize(this->starts_.back());
+     this->next_.assign(this->starts_.begin(), this->starts_.end() - 1);
+     for (size_t i = 0; i < this->herd_of_.size(); i++) {
+         int h = this->herd_of_[i];
+         if (h < 0) {
+             continue;
+         }
+         this->members_[this->next_[h]++] = (int)i;
+         const entityState& state = objects[i]->getPrevious();
+         herd& a_herd = this->herds_[h];
+         long long dx = a_herd.x - state.x(tick);
+         long long dy = a_herd.y - state.y(tick);
+         int dist = (int)ceil(sqrt((double)(dx * dx + dy * dy)));
+         a_herd.radius = std::max(a_herd.radius, dist);
+     }
+ };
+
+ void herdIndex::report() const {
+     size_t used = this->herds_.size() - this->free_.size();
+     std::cout << "Herds: " << used << " now, " << this->members_.size()
+         << " sheep, " << (double)this->strays_ / std::max(1ull, this->ticks_)
+         << " strays per tick" << std::endl;
+     unsigned long long searches = this->searches_.load();
+     std::cout << "  far searches : " << searches << ", "
+         << (double)this->searched_.load() / std::max(1ull, searches)
+         << " herds visited each" << std::endl;
+ };
+
+ tileBins::tileBins(int width, int height)
+     : columns_{ (width + tile_size - 1) / tile_size },
+     rows_{ (height + tile_size - 1) / tile_size } {
+     this->starts_.assign(this->columns_ * this->rows_ + 1, 0);
+ };
+
+ bool tileBins::span(const spriteDraw& draw, int& c0, int& c1, int& r0,
+     int& r1) const {
+     const premultipliedImage& sprite = spriteBank::get().premultiplied(draw.sprite);
+     int x0 = std::max(draw.x, 0);
+     int y0 = std::max(draw.y, 0);
+     int x1 = std::min(draw.x + sprite.w, this->columns_ * tile_size);
+     int y1 = std::min(draw.y + sprite.h, this->rows_ * tile_size);
+     if (x0 >= x1 || y0 >= y1) {
+         return false;
+     }
+     c0 = x0 / tile_size;
+     c1 = (x1 - 1) / tile_size;
+     r0 = y0 / tile_size;
+     r1 = (y1 - 1) / tile_size;
+     return true;
+ };
+
+ // Counting sort of the draws by tile, a draw going in every tile it
+ // overlaps. The entries of a tile keep the order of the list.
+ void tileBins::build(const std::vector<spriteDraw>& draws) {
+     std::fill(this->starts_.begin(), this->starts_.end(), 0);
+     int c0, c1, r0, r1;
+     for (const auto& draw : draws) {
+         if (this->span(draw, c0, c1, r0, r1)) {
+             for (int r = r0; r <= r1; r++) {
+                 for (int c = c0; c <= c1; c++) {
+                     this->starts_[r * this->columns_ + c + 1]++;
+                 }
+             }
+         }
+     }
+     for (size_t tile = 1; tile < this->starts_.size(); tile++) {
+         this->starts_[tile] += this->starts_[tile - 1];
+     }
+     this->indices_.resize(this->starts_.back());
+     this->next_.assign(this->starts_.begin(), this->starts_.end() - 1);
+     for (size_t i = 0; i < draws.size(); i++) {
+         if (this->span(draws[i], c0, c1, r0, r1)) {
+             for (int r = r0; r <= r1; r++) {
+                 for (int c = c0; c <= c1; c++) {
+                     this->indices_[this->next_[r * this->columns_ + c]++] = (int)i;
+                 }
+             }
+         }
+     }
+ };
+
+ // A sprite smaller than a tile overlaps 4 tiles at most
+ void tileBins::reserve(size_t draws) {
+     this->indices_.reserve(4 * draws);
+     this->next_.reserve(this->starts_.size());
+ };
+
+ int tileBins::size() const { return this->columns_ * this->rows_; };
+
+ SDL_Rect tileBins::rect(int tile) const {
+     return { (tile % this->columns_) * tile_size, (tile / this->columns_) * tile_size,
+         tile_size, tile_size };
  };
 
- zombie::zombie(SDL_Surface* window_surface_ptr, int pos_x, int pos_y, int vit_x, int vit_y)
-     : animal("sheep_z.png", window_surface_ptr, pos_x, pos_y, vit_x, vit_y), chasse_{ false }{
-     if (std::rand() % 2 == 0) {
-         vit_x_ = -40;
-     }
-     else {
-         vit_x_ = 40;
-     }
-     if (std::rand() % 2 == 0) {
-         vit_y_ = -40;
-     }
-     else {
-         vit_y_ = 40;
-     }
+ const int* tileBins::entries(int tile) const {
+     return this->indices_.data() + this->starts_[tile];
+ };
 
-     this->properties_.push_back("zombie");
-     if (std::rand() % 2 == 0) {
-         this->properties_.push_back("male");
-     }
-     else {
-         this->properties_.push_back("female");
-     }
-     this->properties_.push_back("0");
-     this->properties_.push_back("alive");
-     this->properties_.push_back("none");
-     this->properties_.push_back("false");
+ size_t tileBins::count(int tile) const {
+     return this->starts_[tile + 1] - this->starts_[tile];
  };
 
- zombie::~zombie() {};
+ species speciesOf(const std::string& type) {
+     if (type == "sheep")
+         return species::sheep;
+     if (type == "wolf")
+         return species::wolf;
+     if (type == "zombie")
+         return species::zombie;
+     if (type == "dog")
+         return species::dog;
+     if (type == "sheperd")
+         return species::sheperd;
+     throw std::runtime_error("speciesOf(): unknown type " + type);
+ };
 
- void zombie::move() {
+ sex sexOf(const std::string& sexe) {
+     return sexe == "male" ? sex::male : sex::female;
+ };
 
-     if (this->escapeTimer_ != 0) {
-         this->escapeTimer_--;
+ namespace {
+ const char* const color_names[(size_t)sheepColor::count] = {
+     "white", "red", "blue", "yellow", "pink", "orange", "purple", "green", "none" };
+ // Multiplied with the colors of the white sheep, white and none keep them
+ const Uint32 color_tints[(size_t)sheepColor::count] = {
+     0xffffff, 0xff0505, 0x1c80ff, 0xffe30d, 0xff3efc, 0xff8305, 0xb405ff, 0x05ff25,
+     0xffffff };
+ } // namespace
+
+ sheepColor colorOf(const std::string& couleur) {
+     for (size_t color = 0; color < (size_t)sheepColor::none; color++) {
+         if (couleur == color_names[color])
+             return (sheepColor)color;
      }
+     return sheepColor::none;
+ };
 
-     if (!chasse_ && !escape_ && this->properties_[5] == "false") {
-         if (this->escapeTimer_ == 500) {
-             if (this->vit_x_ >= 0) {
-                 this->vit_x_ = std::rand() % 80;
-             }
-             else {
-                 this->vit_x_ = -std::rand() % 80;
-             }
-
-             if (this->vit_y_ >= 0) {
-                 this->vit_y_ = 80 - std::abs(this->vit_x_);
+ const char* colorName(sheepColor color) { return color_names[(size_t)color]; };
+
+ sheepSprites::sheepSprites() {
+     spriteBank& bank = spriteBank::get();
+     const char* const bases[(size_t)sex::count] = { "sheep.png", "sheep_f.png" };
+     for (size_t gender = 0; gender < (size_t)sex::count; gender++) {
+         int base = bank.load(bases[gender]);
+         for (size_t color = 0; color < (size_t)sheepColor::count; color++) {
+             int& id = this->ids_[gender * (size_t)sheepColor::count + color];
+             if (color_tints[color] == 0xffffff) {
+                 id = base;
              }
              else {
-                 this->vit_y_ = -80 + std::abs(this->vit_x_);
+                 id = bank.tint(base, std::string(bases[gender]) + "#" + color_names[color],
+                     color_tints[color]);
              }
          }
-         else if (this->escapeTimer_ < 500) {
-             if (std::rand() % 150 == 0) {
-                 if (std::rand() % 2 == 0) {
-                     this->vit_x_ *= -1;
-                     if (std::rand() % 150 == 0) {
-                         this->vit_y_ *= -1;
-                     }
-                 }
-                 else {
-                     this->vit_y_ *= -1;
-                     if (std::rand() % 150 == 0) {
-                         this->vit_x_ *= -1;
-                     }
-                 }
-             }
+     }
+ };
 
-             if (std::rand() % 50 == 0) {
-                 if (this->vit_x_ >= 0) {
-                     this->vit_x_ = std::rand() % 80;
-                 }
-                 else {
-                     this->vit_x_ = -std::rand() % 80;
-                 }
+ // Built by the first sheep
+ const sheepSprites& sheepSprites::get() {
+     static sheepSprites sprites;
+     return sprites;
+ };
 
-                 if (this->vit_y_ >= 0) {
-                     this->vit_y_ = 80 - std::abs(this->vit_x_);
-                 }
-                 else {
-                     this->vit_y_ = -80 + std::abs(this->vit_x_);
-                 }
-             }
-         }
+ int sheepSprites::sprite(sex gender, sheepColor color) const {
+     return this->ids_[(size_t)gender * (size_t)sheepColor::count + (size_t)color];
+ };
+
+ populationManager::populationManager() {
+     for (size_t kind = 0; kind < kinds; kind++) {
+         this->caps_[kind] = { SIZE_MAX, SIZE_MAX };
+         this->alive_[kind] = 0;
+         std::fill(std::begin(this->by_sex_[kind]), std::end(this->by_sex_[kind]), 0);
+         this->peak_[kind] = 0;
+         this->births_[kind] = 0;
+         this->throttled_[kind] = 0;
+         this->refused_[kind] = 0;
      }
+     std::fill(std::begin(this->by_color_), std::end(this->by_color_), 0);
+ };
 
-     this->escape_ = false;
-     this->chasse_ = false;
-     
-     pos_x_ += (frame_time * vit_x_);
-     pos_y_ += (frame_time * vit_y_);
+ void populationManager::setCaps(species kind, caps limits) {
+     this->caps_[(size_t)kind] = limits;
+ };
 
-     if (this->properties_[5] == "true") {
-         if (this->vit_x_ >= 0) {
-             this->vit_x_ = -std::rand() % 80;
-         }
-         else {
-             this->vit_x_ = std::rand() % 80;
-         }
+ size_t populationManager::hardCap(species kind) const {
+     return this->caps_[(size_t)kind].hard;
+ };
 
-         if (this->vit_y_ >= 0) {
-             this->vit_y_ = -80 - std::abs(this->vit_x_);
-         }
-         else {
-             this->vit_y_ = 80 + std::abs(this->vit_x_);
+ bool populationManager::allowBirth(species kind) {
+     size_t k = (size_t)kind;
+     const caps& limits = this->caps_[k];
+     size_t alive = this->alive_[k];
+     if (alive >= limits.hard) {
+         this->refused_[k]++;
+         return false;
+     }
+     if (alive >= limits.soft) {
+         double chance = (double)(limits.hard - alive) / (limits.hard - limits.soft);
+         if (std::rand() >= chance * RAND_MAX) {
+             this->throttled_[k]++;
+             return false;
          }
-         this->properties_[5] = "false";
      }
-
-     this->verifPosition();
+     this->births_[k]++;
+     return true;
  };
- bool zombie::interact(std::shared_ptr<interactiveObject> interObject) {
 
-     if (interObject->getProperties()[0] == "sheperd" && this->properties_[5] == "true") {
-         return this->recule(interObject->get_pos_x(), interObject->get_pos_y());
+ // The sex and the color of an animal never change, only entering and
+ // leaving the zoo moves the counts
+ void populationManager::added(const std::vector<std::string>& properties) {
+     species kind = speciesOf(properties[0]);
+     size_t k = (size_t)kind;
+     this->alive_[k]++;
+     this->by_sex_[k][(size_t)sexOf(properties[1])]++;
+     if (kind == species::sheep) {
+         this->by_color_[(size_t)colorOf(properties[4])]++;
      }
+     this->peak_[k] = std::max(this->peak_[k], this->alive_[k]);
+ };
 
-     if (interObject->getProperties()[3] == "alive" &&
-         interObject->getProperties()[0] != "zombie") {
-         if (this->croque(interObject->get_pos_x(), interObject->get_pos_y())) {
-             interObject->getProperties()[3] = "dead";
-             return true;
-         }
+ void populationManager::removed(const std::vector<std::string>& properties) {
+     species kind = speciesOf(properties[0]);
+     size_t k = (size_t)kind;
+     this->alive_[k]--;
+     this->by_sex_[k][(size_t)sexOf(properties[1])]--;
+     if (kind == species::sheep) {
+         this->by_color_[(size_t)colorOf(properties[4])]--;
      }
-     return false;
  };
- bool zombie::croque(int pos_sheep_x, int pos_sheep_y) {
-     unsigned int distMout =
-         sqrt(((pos_sheep_x - this->pos_x_) * (pos_sheep_x - this->pos_x_)) +
-             ((pos_sheep_y - this->pos_y_) * (pos_sheep_y - this->pos_y_)));
 
-     if (distMout < 50) {
-         this->pos_x_ = pos_sheep_x;
-         this->pos_y_ = pos_sheep_y;
-         return true;
-     }
-     else {
-         int distx =
-             sqrt((pos_sheep_x - this->pos_x_) * (pos_sheep_x - this->pos_x_));
-         int disty =
-             sqrt((pos_sheep_y - this->pos_y_) * (pos_sheep_y - this->pos_y_));
-         this->vit_x_ = 80 * (sqrt(distMout * distMout - disty * disty) / distMout);
+ size_t populationManager::count(species kind) const {
+     return this->alive_[(size_t)kind];
+ };
 
-         this->vit_y_ = 80 - this->vit_x_;
+ size_t populationManager::count(species kind, sex a_sex) const {
+     return this->by_sex_[(size_t)kind][(size_t)a_sex];
+ };
 
-         if ((this->pos_x_ - pos_sheep_x) > 0) {
-             this->vit_x_ = -this->vit_x_;
+ size_t populationManager::count(sheepColor color) const {
+     return this->by_color_[(size_t)color];
+ };
+
+ void populationManager::report() const {
+     const char* const names[kinds] = { "sheep", "wolf", "zombie", "dog", "sheperd" };
+     std::cout << "Population (alive / peak / births / suppressed near cap / at cap)"
+         << std::endl;
+     for (size_t k = 0; k < kinds; k++) {
+         if (this->peak_[k] == 0) {
+             continue;
          }
-         if ((this->pos_y_ - pos_sheep_y) > 0) {
-             this->vit_y_ = -this->vit_y_;
+         std::cout << "  " << names[k] << " : " << this->alive_[k] << " / "
+             << this->peak_[k] << " / " << this->births_[k] << " / "
+             << this->throttled_[k] << " / " << this->refused_[k];
+         if (this->caps_[k].hard != SIZE_MAX) {
+             std::cout << " (caps " << this->caps_[k].soft << ", "
+                 << this->caps_[k].hard << ")";
          }
+         std::cout << ", " << this->by_sex_[k][(size_t)sex::male] << " male, "
+             << this->by_sex_[k][(size_t)sex::female] << " female" << std::endl;
+     }
+     std::cout << "  sheep colors :";
+     for (size_t color = 0; color < (size_t)sheepColor::none; color++) {
+         std::cout << " " << colorName((sheepColor)color) << " " << this->by_color_[color];
      }
+     std::cout << std::endl;
+ };
 
-     this->chasse_ = true;
+ spawnScheduler::spawnScheduler()
+     : queue_(64), head_{ 0 },
+     size_{ 0 }, max_depth_{ 0 }, spawned_{ 0 }, built_late_{ 0 },
+     busy_ticks_{ 0 } {};
 
-     return false;
+ void spawnScheduler::prebuild(size_t count) {
+     this->pool_.reserve(this->pool_.size() + count);
+     for (size_t i = 0; i < count; i++) {
+         this->pool_.push_back(std::make_shared<zombie>(0, 0, 0, 0));
+     }
  };
 
- bool zombie::recule(int pos_sheperd_x, int pos_sheperd_y) {
-     int distSheperd = sqrt(((pos_sheperd_x - this->pos_x_) * (pos_sheperd_x - this->pos_x_)) +
-         ((pos_sheperd_y - this->pos_y_) * (pos_sheperd_y - this->pos_y_)));
-
-     int distx = sqrt((pos_sheperd_x - this->pos_x_) * (pos_sheperd_x - this->pos_x_));
-     int disty = sqrt((pos_sheperd_y - this->pos_y_) * (pos_sheperd_y - this->pos_y_));
-     this->vit_x_ = 500 * (sqrt(distSheperd * distSheperd - disty * disty) / distSheperd);
+ void spawnScheduler::request(int x, int y) {
+     if (this->size_ == this->queue_.size()) {
+         std::vector<spawn> larger(2 * this->queue_.size());
+         for (size_t i = 0; i < this->size_; i++) {
+             larger[i] = this->queue_[(this->head_ + i) % this->queue_.size()];
+         }
+         this->queue_ = std::move(larger);
+         this->head_ = 0;
+     }
+     this->queue_[(this->head_ + this->size_) % this->queue_.size()] = { x, y };
+     this->size_++;
+     this->max_depth_ = std::max(this->max_depth_, this->size_);
+ };
 
-     this->vit_y_ = 500 - this->vit_x_;
+ std::shared_ptr<zombie> spawnScheduler::take(int x, int y) {
+     if (this->pool_.empty()) {
+         this->built_late_++;
+         return std::make_shared<zombie>(x, y, 0, 0);
+     }
+     std::shared_ptr<zombie> a_zombie = std::move(this->pool_.back());
+     this->pool_.pop_back();
+     a_zombie->set_pos(x, y);
+     return a_zombie;
+ };
 
-     if ((this->pos_x_ - pos_sheperd_x) < 0) {
-         this->vit_x_ = -this->vit_x_;
+ void spawnScheduler::report() const {
+     if (this->max_depth_ == 0) {
+         return;
      }
-     if ((this->pos_y_ - pos_sheperd_y) < 0) {
-         this->vit_y_ = -this->vit_y_;
+     std::cout << "Zombie spawns: " << this->spawned_ << " over " << this->busy_ticks_
+         << " ticks, queue depth max " << this->max_depth_ << ", now "
+         << this->size_ << std::endl;
+     std::cout << "  pool left : " << this->pool_.size() << ", built during a tick : "
+         << this->built_late_ << std::endl;
+ };
+
+ namespace {
+ // A soft disc of wool, more opaque and darker with the level
+ SDL_Surface* makeCrowdPatch(int size, int level, int levels) {
+     SDL_Surface* patch = SDL_CreateRGBSurfaceWithFormat(0, size, size, 32,
+         SDL_PIXELFORMAT_ARGB8888);
+     if (!patch)
+         throw std::runtime_error("makeCrowdPatch(): " + std::string(SDL_GetError()));
+     double shade = (double)level / std::max(1, levels - 1);
+     Uint32 red = (Uint32)(235 - 110 * shade);
+     Uint32 green = (Uint32)(230 - 115 * shade);
+     Uint32 blue = (Uint32)(210 - 120 * shade);
+     double opacity = 120 + 100 * shade;
+     double radius = size / 2.;
+     for (int y = 0; y < size; y++) {
+         Uint32* row = (Uint32*)((Uint8*)patch->pixels + (size_t)y * patch->pitch);
+         for (int x = 0; x < size; x++) {
+             double dist = hypot(x + 0.5 - radius, y + 0.5 - radius) / radius;
+             Uint32 alpha = (Uint32)(opacity * std::clamp(1.5 - 1.5 * dist, 0., 1.));
+             row[x] = (alpha << 24) | (red << 16) | (green << 8) | blue;
+         }
      }
-     return true;
+     return patch;
  }
 
- dog::dog(SDL_Surface* window_surface_ptr, std::shared_ptr<sheperd> maitre)
-     : animal("dog.png", window_surface_ptr), maitre_{ maitre }, proche_{ true } {
-     this->pos_x_ = this->maitre_->get_pos_x() + 20;
-     this->pos_y_ = this->maitre_->get_pos_y() + 20;
-
-     this->properties_.push_back("dog");
-     if (std::rand() % 2 == 0) {
-         this->properties_.push_back("male");
+ // Start of a view of the world along one axis, centered on center and in
+ // the world, or centering the world when it is smaller than the view
+ int cameraAxis(int center, double view, int world) {
+     if (view >= world) {
+         return (int)floor((world - view) / 2);
      }
-     else {
-         this->properties_.push_back("female");
+     return std::clamp((int)(center - view / 2), 0, (int)(world - view));
+ }
+ } // namespace
+
+ ground::ground(renderBackend* backend, int world_width, int world_height)
+     : backend_{ backend }, sdl_rect_{ new SDL_Rect{ 0, 0, frame_width,
+                                                    frame_height} },
+     halloween_{false}, late_sheperd_{false},
+     grid_{ 200, world_width, world_height }, grid_fresh_{ false }, use_herds_{ false },
+     tiles_{ frame_width, frame_height },
+     world_width_{ world_width }, world_height_{ world_height },
+     camera_x_{ 0 }, camera_y_{ 0 }, zoom_{ 1. }, render_frames_{ 0 }, culled_{ 0 },
+     arenas_(1), ticks_{ 0 }, fallbacks_{ 0 },
+     heap_ticks_{ 0 }, last_heap_tick_{ 0 },
+     intents_(1, intentList(arenaAllocator<intent>(arenas_[0]))), near_(1, nullptr),
+     executor_{ nullptr }, draw_{ true }, crowd_population_{ 0 }, crowd_density_{ 0 },
+     cursor_x_{ -2 * crowd_focus }, cursor_y_{ -2 * crowd_focus },
+     crowd_columns_{ (frame_width + crowd_tile - 1) / crowd_tile },
+     crowd_rows_{ (frame_height + crowd_tile - 1) / crowd_tile },
+     crowd_counts_(crowd_columns_ * crowd_rows_, 0),
+     crowd_sprite_(crowd_columns_ * crowd_rows_, 0),
+     crowd_frames_{ 0 }, crowd_tiles_{ 0 }, crowd_hidden_{ 0 } {
+     this->background_ = spriteBank::get().load(image_ground);
+     this->background_halloween_ = spriteBank::get().load(image_ground_halloween);
+     // Before the animals, so the patches are drawn under them
+     for (int level = 0; level < crowd_levels; level++) {
+         this->crowd_patches_[level] = spriteBank::get().add(
+             "crowd" + std::to_string(level),
+             makeCrowdPatch(crowd_tile, level, crowd_levels));
      }
-     this->properties_.push_back("0");
-     this->properties_.push_back("alive");
-     this->properties_.push_back("none");
-     this->properties_.push_back("false");
  };
 
- dog::~dog() {};
+ ground::~ground() {
+     delete this->sdl_rect_;
+     sdl_rect_ = nullptr;
+ };
 
- void dog::move() {
+ bool ground::get_Haloween() { return this->halloween_; };
 
-     if (this->proche_) {
-         if (std::rand() % 150 == 0) {
-             if (std::rand() % 2 == 0) {
-                 this->vit_x_ *= -1;
-                 if (std::rand() % 150 == 0) {
-                     this->vit_y_ *= -1;
-                 }
-             }
-             else {
-                 this->vit_y_ *= -1;
-                 if (std::rand() % 150 == 0) {
-                     this->vit_x_ *= -1;
-                 }
-             }
-         }
+ void ground::true_halloween() { this->halloween_ = true; };
 
-         if (std::rand() % 10 == 0) {
-             if (this->vit_x_ >= 0) {
-                 this->vit_x_ = std::rand() % 80;
+ void ground::add_animal(std::shared_ptr<interactiveObject> an_animal) {
+     an_animal->setTimerWheel(&this->timers_);
+     this->population_.added(an_animal->getProperties());
+     if (an_animal->getProperties()[0] == "sheperd") {
+         this->sheperd_ = an_animal;
+         this->sheperd_index_ = (int)this->the_zoo.size();
+     }
+     an_animal->reindex((int)this->the_zoo.size());
+     the_zoo.push_back(an_animal);
+ };
+
+ void ground::useTaskGraph(taskExecutor* executor) {
+     this->executor_ = executor;
+     this->graph_ = taskGraph();
+     this->prefetch_graph_ = taskGraph();
+     this->arenas_.resize(executor ? executor->size() : 1);
+     this->intents_.resize(this->arenas_.size(),
+         intentList(arenaAllocator<intent>(this->arenas_[0])));
+     this->near_.assign(this->arenas_.size(), nullptr);
+     this->resetArenas();
+     if (!executor) {
+         return;
+     }
+     // The grid task has nothing to do when the grid was prefetched during
+     // the previous present.
+     int grid = this->graph_.add("grid build", [this] {
+         if (!this->grid_fresh_) {
+             this->buildGrid();
+         }
+     });
+     int inputs = this->graph_.add("input intents", [this] { this->applyInputs(); },
+         { grid });
+     unsigned chunks = executor->size();
+     int pair_pass = this->graph_.addParallel("pairs", chunks,
+         [this](unsigned chunk, unsigned chunks) { this->pairs(chunk, chunks); },
+         { inputs });
+     int decisions = this->graph_.addParallel("decisions", chunks,
+         [this](unsigned chunk, unsigned chunks) { this->decide(chunk, chunks); },
+         { pair_pass });
+     int conflicts = this->graph_.add("conflict resolution", [this] {
+         this->merge();
+         this->resolve();
+     }, { decisions });
+     int integration = this->graph_.add("integration", [this] { this->integrate(); },
+         { conflicts });
+     int spawn = this->graph_.add("spawn/despawn", [this] {
+         this->spawnDespawn();
+         this->resetArenas();
+     }, { integration });
+     int render_list = this->graph_.add("render list", [this] {
+         if (this->draw_) {
+             this->buildRenderList(this->draws_);
+         }
+     }, { spawn });
+     if (this->backend_->tiles()) {
+         // The frame is composited tile by tile on every thread
+         int bins = this->graph_.add("tile bins", [this] {
+             if (this->draw_) {
+                 this->tiles_.build(this->draws_);
+                 this->backend_->beginTiles(
+                     this->halloween_ ? this->background_halloween_ : this->background_,
+                     this->draws_.data(), this->draws_.size());
              }
-             else {
-                 this->vit_x_ = -std::rand() % 80;
+         }, { render_list });
+         int tiles = this->graph_.addParallel("tiles", chunks,
+             [this](unsigned chunk, unsigned chunks) {
+                 if (this->draw_) {
+                     this->drawTiles(chunk, chunks);
+                 }
+             }, { bins });
+         this->graph_.add("tiles done", [this] {
+             if (this->draw_) {
+                 this->backend_->endTiles();
              }
-
-             if (this->vit_y_ >= 0) {
-                 this->vit_y_ = 100 - std::abs(this->vit_x_);
+         }, { tiles });
+     }
+     else {
+         // The background only touches the window surface, it is restored
+         // while the simulation runs
+         int background = this->graph_.add("background", [this] {
+             if (this->draw_) {
+                 this->drawBackground();
              }
-             else {
-                 this->vit_y_ = -100 + std::abs(this->vit_x_);
+         });
+         this->graph_.add("blit", [this] {
+             if (this->draw_) {
+                 this->blitRenderList();
              }
-         }
+         }, { background, render_list });
      }
 
-     pos_x_ += (frame_time * vit_x_);
-     pos_y_ += (frame_time * vit_y_);
+     this->prefetch_graph_.add("grid build (next tick)", [this] { this->buildGrid(); });
+ };
 
-     this->proche_ = true;
+ void ground::startPrefetch() {
+     if (this->executor_) {
+         this->executor_->start(this->prefetch_graph_);
+     }
+ };
 
-     this->verifPosition();
+ void ground::finishPrefetch() {
+     if (this->executor_) {
+         this->executor_->wait();
+     }
  };
 
- bool dog::interact(std::shared_ptr<interactiveObject> interObject) {
-     if (interObject->getProperties()[0] == "zombie") {
-         return this->escape(interObject->get_pos_x(), interObject->get_pos_y());
+ void ground::report() const {
+     this->graph_.report();
+     this->prefetch_graph_.report();
+     this->spawner_.report();
+     if (this->use_herds_) {
+         this->herds_.report();
+     }
+     this->population_.report();
+     if (this->render_frames_ > 0 && (this->world_width_ > (int)frame_width ||
+         this->world_height_ > (int)frame_height)) {
+         std::cout << "Culling: " << this->culled_ / (double)this->render_frames_
+             << " sprites out of the window per frame" << std::endl;
      }
-     if (interObject->getProperties()[0] == "sheperd") {
-         int distSheperd = sqrt(((this->maitre_->get_pos_x() - this->pos_x_) *
-             (this->maitre_->get_pos_x() - this->pos_x_)) +
-             ((this->maitre_->get_pos_y() - this->pos_y_) *
-                 (this->maitre_->get_pos_y() - this->pos_y_)));
-         if (distSheperd > 50) {
-             this->proche_ = false;
+     if (this->idle_sum_ > 0) {
+         std::cout << "Planned motion: " << (double)this->idle_sum_ /
+             std::max(1u, this->ticks_) << " idle animals per tick" << std::endl;
+     }
+     if (this->crowd_density_ > 0) {
+         double frames = (double)std::max(1ull, this->crowd_frames_);
+         std::cout << "Crowds: " << this->crowd_tiles_ / frames << " tiles, "
+             << this->crowd_hidden_ / frames << " sprites left out per frame"
+             << std::endl;
+     }
+     size_t capacity = 0;
+     size_t peak = 0;
+     for (const auto& arena : this->arenas_) {
+         capacity += arena.capacity();
+         peak = std::max(peak, arena.peak());
+     }
+     std::cout << "Frame arenas: " << this->arenas_.size() << " slots, "
+         << capacity / 1024 << " KiB, peak " << peak << " bytes per slot" << std::endl;
+     std::cout << "  ticks using the heap : " << this->heap_ticks_ << " of "
+         << this->ticks_ << ", last one tick " << this->last_heap_tick_ << std::endl;
+ };
 
-             int distx = sqrt((this->maitre_->get_pos_x() - this->pos_x_) *
-                 (this->maitre_->get_pos_x() - this->pos_x_));
-             int disty = sqrt((this->maitre_->get_pos_y() - this->pos_y_) *
-                 (this->maitre_->get_pos_y() - this->pos_y_));
-             this->vit_x_ =
-                 180 * (sqrt(distSheperd * distSheperd - disty * disty) / distSheperd);
+ void ground::prebuildZombies(size_t count) { this->spawner_.prebuild(count); };
+
+ // Growing up to the caps never reallocates the zoo or the lists built from
+ // it during a tick
+ void ground::setPopulationCaps(populationManager::caps sheep_caps,
+     populationManager::caps zombie_caps) {
+     this->population_.setCaps(species::sheep, sheep_caps);
+     this->population_.setCaps(species::zombie, zombie_caps);
+     size_t capacity = this->the_zoo.size() + sheep_caps.hard + zombie_caps.hard;
+     this->the_zoo.reserve(capacity);
+     this->draws_.reserve(capacity);
+     this->unsorted_.reserve(capacity);
+     this->tiles_.reserve(capacity);
+     this->crowd_tile_of_.reserve(capacity);
+     this->movers_.reserve(capacity);
+     this->grid_.reserve(capacity);
+     this->herds_.reserve(capacity);
+ };
 
-             this->vit_y_ = 180 - this->vit_x_;
+ void ground::useHerds(bool use_herds) { this->use_herds_ = use_herds; };
 
-             if ((this->pos_x_ - this->maitre_->get_pos_x()) > 0) {
-                 this->vit_x_ = -this->vit_x_;
-             }
-             if ((this->pos_y_ - this->maitre_->get_pos_y()) > 0) {
-                 this->vit_y_ = -this->vit_y_;
-             }
+ void ground::setCrowd(size_t population, size_t density) {
+     this->crowd_population_ = population;
+     this->crowd_density_ = density;
+ };
 
-         }
-         else {
-             this->proche_ = true;
-         }
-         return true;
+ void ground::update() {
+     if (this->executor_) {
+         this->draw_ = true;
+         this->executor_->run(this->graph_);
+         return;
      }
-     return false;
+     this->step();
+     this->draw();
  };
 
- bool dog::escape(int pos_dog_x, int pos_dog_y) {
-
-     this->escape_ = true;
-     int distDog = sqrt(((pos_dog_x - this->pos_x_) * (pos_dog_x - this->pos_x_)) +
-         ((pos_dog_y - this->pos_y_) * (pos_dog_y - this->pos_y_)));
+ void ground::step() {
+     if (this->executor_) {
+         this->draw_ = false;
+         this->executor_->run(this->graph_);
+         return;
+     }
+     if (!this->grid_fresh_) {
+         this->buildGrid();
+     }
+     this->applyInputs();
+     this->pairs(0, 1);
+     this->decide(0, 1);
+     this->merge();
+     this->resolve();
+     this->integrate();
+     this->spawnDespawn();
+     this->resetArenas();
+ };
 
-     if (this->escapeTimer_ == 0) {
-         int distx = sqrt((pos_dog_x - this->pos_x_) * (pos_dog_x - this->pos_x_));
-         int disty = sqrt((pos_dog_y - this->pos_y_) * (pos_dog_y - this->pos_y_));
-         this->vit_x_ = 100 * (sqrt(distDog * distDog - disty * disty) / distDog);
+ void ground::draw() {
+     this->drawBackground();
+     this->buildRenderList(this->draws_);
+     this->blitRenderList();
+ };
 
-         this->vit_y_ = 100 - this->vit_x_;
+ void ground::fillSnapshot(renderSnapshot& snapshot) {
+     snapshot.background =
+         this->halloween_ ? this->background_halloween_ : this->background_;
+     this->buildRenderList(snapshot.draws);
+ };
 
-         if ((this->pos_x_ - pos_dog_x) < 0) {
-             this->vit_x_ = -this->vit_x_;
-         }
-         if ((this->pos_y_ - pos_dog_y) < 0) {
-             this->vit_y_ = -this->vit_y_;
+ // The grid and the saved states are the read-only view of the world the
+ // decisions of the tick work on
+ void ground::buildGrid() {
+     // Saved first. The idle animals keep the state of their path, the
+     // grid and the herds read where it is at this tick.
+     for (size_t i = 0; i < this->the_zoo.size(); i++) {
+         if (!this->the_zoo[i]->idle()) {
+             this->the_zoo[i]->saveState((int)i);
          }
-
-         this->escapeTimer_ = 1000;
-
      }
-     else {
-         int distx = sqrt((pos_dog_x - this->pos_x_) * (pos_dog_x - this->pos_x_));
-         int disty = sqrt((pos_dog_y - this->pos_y_) * (pos_dog_y - this->pos_y_));
-         this->vit_x_ = 80 * (sqrt(distDog * distDog - disty * disty) / distDog);
-
-         this->vit_y_ = 80 - this->vit_x_;
-
-         if ((this->pos_x_ - pos_dog_x) < 0) {
-             this->vit_x_ = -this->vit_x_;
-         }
-         if ((this->pos_y_ - pos_dog_y) < 0) {
-             this->vit_y_ = -this->vit_y_;
-         }
+     this->grid_.build(this->the_zoo, this->timers_.now());
+     if (this->use_herds_) {
+         this->herds_.update(this->the_zoo, this->timers_.now());
      }
-
-     return true;
+     this->grid_fresh_ = true;
  };
 
- ground::ground(SDL_Surface* window_surface_ptr)
-     : window_surface_ptr_{ window_surface_ptr }, sdl_rect_{ new SDL_Rect{
-                                                    0, 0, frame_width,
-                                                    frame_height} }, halloween_{false} {};
-
- ground::~ground() {
-     delete this->sdl_rect_;
-     sdl_rect_ = nullptr;
+ // The clicks of the sheperd, queued by clickButton
+ void ground::applyInputs() {
+     for (const auto& an_intent : this->input_intents_) {
+         auto& target = this->the_zoo[an_intent.target];
+         if (an_intent.type == intent::hit && target->isAlive()) {
+             target->getProperties()[5] = "true";
+             intentList none(arenaAllocator<intent>(this->arenas_[0]));
+             target->interact(this->the_zoo[an_intent.source]->getPrevious(), none);
+         }
+     }
+     this->input_intents_.clear();
  };
 
- bool ground::get_Haloween() { return this->halloween_; };
+ // Every pair of animals within pairRadius() is visited once: its distance
+ // is computed once and offered to the nearest slots of both animals. The
+ // chunks write their own slots, the decisions keep the nearest of them.
+ // The grid also visits pairs further than pairRadius(), in the corners of
+ // its cells. They are left out: a rule reaching anywhere would keep one of
+ // them over a nearer animal in a cell that was not visited, the search of
+ // the whole field finds them instead.
+ void ground::pairs(unsigned chunk, unsigned chunks) {
+     const long long radius2 = (long long)pairRadius() * pairRadius();
+     const unsigned long long now = this->timers_.now();
+     size_t slot_count = this->the_zoo.size() * rule_ranks;
+     nearSlot* slots = static_cast<nearSlot*>(this->arenas_[chunk].allocate(
+         slot_count * sizeof(nearSlot), alignof(nearSlot)));
+     std::fill(slots, slots + slot_count, nearSlot{ LLONG_MAX, -1 });
+     this->near_[chunk] = slots;
+     this->grid_.forEachPair(pairRadius(), chunk, chunks, [&](int i, int j) {
+         const entityState& a = this->the_zoo[i]->getPrevious();
+         const entityState& b = this->the_zoo[j]->getPrevious();
+         const pairReach& reach_a = reachOf(a);
+         const pairReach& reach_b = reachOf(b);
+         if (reach_a.dist2[(size_t)b.kind] < 0 && reach_b.dist2[(size_t)a.kind] < 0) {
+             return;
+         }
+         long long dx = b.x(now) - a.x(now);
+         long long dy = b.y(now) - a.y(now);
+         long long dist = dx * dx + dy * dy;
+         if (dist > radius2) {
+             return;
+         }
+         offerNearest(reach_a, b, dist, slots + i * rule_ranks);
+         offerNearest(reach_b, a, dist, slots + j * rule_ranks);
+     });
+ };
 
- void ground::true_halloween() { this->halloween_ = true; };
+ // Every animal of the chunk decides alone: it only writes itself and its
+ // intents, so the chunks can run at the same time
+ void ground::decide(unsigned chunk, unsigned chunks) {
+     size_t count = this->the_zoo.size();
+     size_t first = count * chunk / chunks;
+     size_t last = count * (chunk + 1) / chunks;
+     intentList& intents = this->intents_[chunk];
+     for (size_t i = first; i < last; i++) {
+         if (this->inTick(i)) {
+             this->interract(this->the_zoo[i], intents);
+         }
+     }
+ };
 
- void ground::add_animal(std::shared_ptr<interactiveObject> an_animal) {
-     the_zoo.push_back(an_animal);
+ // Applies the intents in an order that does not depend on the zoo order:
+ // kills first, then the matings, by target then by source. A female claimed
+ // by two males only mates with the first one.
+ void ground::merge() {
+     intentList merged(arenaAllocator<intent>(this->arenas_[0]));
+     size_t count = 0;
+     for (const auto& intents : this->intents_) {
+         count += intents.size();
+     }
+     merged.reserve(count);
+     for (const auto& intents : this->intents_) {
+         merged.insert(merged.end(), intents.begin(), intents.end());
+     }
+     std::sort(merged.begin(), merged.end(),
+         [](const intent& a, const intent& b) {
+             if (a.type != b.type) return a.type < b.type;
+             if (a.target != b.target) return a.target < b.target;
+             return a.source < b.source;
+         });
+     for (const auto& an_intent : merged) {
+         // Bound by reference: no count of the shared_ptr to change per intent.
+         // birth() may grow the zoo, they are not read after it.
+         const auto& source = this->the_zoo[an_intent.source];
+         const auto& target = this->the_zoo[an_intent.target];
+         if (an_intent.type == intent::kill) {
+             target->kill();
+         }
+         else if (an_intent.type == intent::mate) {
+             // Only sheep mate
+             sheep& father = static_cast<sheep&>(*source);
+             sheep& mother = static_cast<sheep&>(*target);
+             if (father.isAlive() && mother.isAlive() &&
+                 father.fertile() && mother.fertile()) {
+                 father.startReproductionTimer();
+                 mother.startReproductionTimer();
+                 this->birth(source, target);
+             }
+         }
+     }
  };
 
- void ground::update() {
-     if (!this->halloween_) {
-         image_ptr_ = IMG_Load(image_ground.c_str());
+ void ground::birth(const std::shared_ptr<interactiveObject>& parent,
+     const std::shared_ptr<interactiveObject>& partner) {
+     if (!this->population_.allowBirth(species::sheep)) {
+         return;
+     }
+     // The lamb is born where the mother is, she may be on a planned path
+     partner->syncPosition();
+     const std::string& couleurp = parent->getProperties()[4];
+     const std::string& couleurm = partner->getProperties()[4];
+     if ((couleurp == "white" || couleurm == "white") &&
+         (couleurm == "red" || couleurp == "red")) {
+         this->add_animal(
+             std::make_shared<sheep>(partner->get_pos_x(),
+                 partner->get_pos_y(), 0, 0, "pink"));
+     }
+     else if ((couleurp == "blue" || couleurm == "blue") &&
+         (couleurm == "red" || couleurp == "red")) {
+         this->add_animal(
+             std::make_shared<sheep>(partner->get_pos_x(),
+                 partner->get_pos_y(), 0, 0, "purple"));
+     }
+     else if ((couleurp == "yellow" || couleurm == "yellow") &&
+         (couleurm == "red" || couleurp == "red")) {
+         this->add_animal(
+             std::make_shared<sheep>(partner->get_pos_x(),
+                 partner->get_pos_y(), 0, 0, "orange"));
+     }
+     else if ((couleurp == "blue" || couleurm == "blue") &&
+         (couleurm == "yellow" || couleurp == "yellow")) {
+         this->add_animal(
+             std::make_shared<sheep>(partner->get_pos_x(),
+                 partner->get_pos_y(), 0, 0, "green"));
      }
      else {
-         image_ptr_ = IMG_Load(image_ground_halloween.c_str());
-     }
-
-     if (!image_ptr_) {
-         std::cout << "Image not found" << std::endl;
-     }
-     SDL_Rect rect;
-     rect.x = 0;
-     rect.y = 0;
-     rect.w = image_ptr_->w;
-     rect.h = image_ptr_->h;
-     SDL_BlitScaled(image_ptr_, NULL, window_surface_ptr_, &rect);
-     int distance = INT16_MAX;
-     old_zoo = the_zoo;
-     for (int i = 0; i < old_zoo.size(); i++) {
-         if (old_zoo[i]->getProperties()[3] == "alive") {
-             this->interract(old_zoo[i]);
-             old_zoo[i]->move();
-             old_zoo[i]->draw();
-         }
-         else if (old_zoo[i]->getProperties()[3] == "dead" && !this->halloween_) {
-             for (int j = 0; j < the_zoo.size(); j++) {
-                 if (the_zoo[j] == old_zoo[i]) {
-                     dead++;
-                     the_zoo.erase(the_zoo.begin() + j);
-                 }
-             }
+         if (std::rand() % 2 == 0) {
+             this->add_animal(std::make_shared<sheep>(
+                 partner->get_pos_x(), partner->get_pos_y(), 0, 0, couleurp));
          }
-         else if (old_zoo[i]->getProperties()[3] == "dead" && this->halloween_) {
-             for (int j = 0; j < the_zoo.size(); j++) {
-                 if (the_zoo[j] == old_zoo[i]) {
-                     this->add_animal(std::make_shared<zombie>(window_surface_ptr_, the_zoo[j]->get_pos_x(), the_zoo[j]->get_pos_y(), 0, 0));
-                     the_zoo.erase(the_zoo.begin() + j);
-                 }
-             }
+         else {
+             this->add_animal(std::make_shared<sheep>(
+                 partner->get_pos_x(), partner->get_pos_y(), 0, 0, couleurm));
          }
-         if (this->halloween_) {
-             for (int i = 0; i < dead; i++) {
-                 int rand = std::rand()%5;
+     }
+ };
+
+ // The animals killed during the decisions leave the zoo, or come back as
+ // zombies during halloween
+ void ground::resolve() {
+     size_t kept = 0;
+     this->movers_.clear();
+     for (size_t i = 0; i < this->the_zoo.size(); i++) {
+         if (!this->the_zoo[i]->isAlive()) {
+             this->the_zoo[i]->syncPosition();
+             this->population_.removed(this->the_zoo[i]->getProperties());
+             if (this->the_zoo[i] == this->sheperd_) {
+                 this->sheperd_.reset();
+                 this->sheperd_index_ = -1;
+             }
+             if (!this->halloween_) {
+                 int rand = std::rand() % 5;
                  if (rand == 0) {
-                     this->add_animal(std::make_shared<zombie>(window_surface_ptr_, 0+frame_boundary, 0+frame_boundary , 0, 0));
+                     this->spawner_.request(0 + frame_boundary, 0 + frame_boundary);
                  }
                  else if (rand == 1) {
-                     this->add_animal(std::make_shared<zombie>(window_surface_ptr_, frame_width + frame_boundary, frame_height+frame_boundary, 0, 0));
+                     this->spawner_.request(this->world_width_ + frame_boundary,
+                         this->world_height_ + frame_boundary);
                  }
-                 else if(rand == 2) {
-                     this->add_animal(std::make_shared<zombie>(window_surface_ptr_, 0 + frame_boundary, frame_height + frame_boundary, 0, 0));
+                 else if (rand == 2) {
+                     this->spawner_.request(0 + frame_boundary, this->world_height_ + frame_boundary);
                  }
                  else {
-                     this->add_animal(std::make_shared<zombie>(window_surface_ptr_, frame_width + frame_boundary, 0 + frame_boundary, 0, 0));
+                     this->spawner_.request(this->world_width_ + frame_boundary, 0 + frame_boundary);
                  }
-                 
+                 continue;
              }
-             dead = 0;
+             if (!this->population_.allowBirth(species::zombie)) {
+                 continue;
+             }
+             this->the_zoo[i] = this->spawner_.take(
+                 this->the_zoo[i]->get_pos_x(), this->the_zoo[i]->get_pos_y());
+             this->the_zoo[i]->setTimerWheel(&this->timers_);
+             this->population_.added(this->the_zoo[i]->getProperties());
          }
-
+         if (kept != i) {
+             this->the_zoo[kept] = std::move(this->the_zoo[i]);
+             if (this->the_zoo[kept] == this->sheperd_) {
+                 this->sheperd_index_ = (int)kept;
+             }
+         }
+         this->the_zoo[kept]->reindex((int)kept);
+         if (!this->the_zoo[kept]->idle()) {
+             this->movers_.push_back((int)kept);
+         }
+         kept++;
      }
+     this->the_zoo.resize(kept);
+     this->idle_sum_ += kept - this->movers_.size();
  };
 
- void ground::interract(std::shared_ptr<interactiveObject> an_animal) {
-     if (an_animal->getProperties()[0] == "sheep") {
+ // The late sheperd is moved and drawn by updateSheperd()
+ bool ground::inTick(size_t i) const {
+     return this->the_zoo[i]->isAlive() &&
+         !(this->late_sheperd_ && (int)i == this->sheperd_index_);
+ };
 
-         unsigned int distLoup = INT16_MAX;
-         unsigned int newDistLoup = 0;
-         unsigned int distLove = INT16_MAX;
-         unsigned int newDistLove = 0;
-         unsigned int distZombie = INT16_MAX;
-         unsigned int newDistZombie = 0;
-         std::shared_ptr<interactiveObject> loup = nullptr;
-         std::shared_ptr<interactiveObject> moutone = nullptr;
-         std::shared_ptr<interactiveObject> zombie = nullptr;
+ // The timers due at this tick fire before the moves that depend on them.
+ // The idle sheep are not moved: their path goes on without them until its
+ // next event, which moves them from the timers.
+ void ground::integrate() {
+     this->timers_.advance();
+     for (int i : this->movers_) {
+         if (this->inTick(i)) {
+             this->the_zoo[i]->move();
+         }
+     }
+ };
 
-         for (auto& another_animal : this->the_zoo) {
+ // The animals eaten before halloween come back as zombies from the corners,
+ // a few per tick
+ void ground::spawnDespawn() {
+     if (this->halloween_) {
+         this->spawner_.release([this](int x, int y) {
+             if (this->population_.allowBirth(species::zombie)) {
+                 this->add_animal(this->spawner_.take(x, y));
+             }
+         });
+     }
+     // Positions changed, the next tick needs a new grid
+     this->grid_fresh_ = false;
+ };
 
-             if (another_animal->getProperties()[0] == "zombie") {
+ // The lists of the tick are dropped with their arenas. A tick where an
+ // arena had to use the heap is counted, none should come after warm-up.
+ void ground::resetArenas() {
+     unsigned fallbacks = 0;
+     for (size_t slot = 0; slot < this->arenas_.size(); slot++) {
+         this->intents_[slot] = intentList(arenaAllocator<intent>(this->arenas_[slot]));
+         fallbacks += this->arenas_[slot].fallbacks();
+         this->arenas_[slot].reset();
+     }
+     this->ticks_++;
+     if (fallbacks != this->fallbacks_) {
+         this->heap_ticks_++;
+         this->last_heap_tick_ = this->ticks_;
+         this->fallbacks_ = fallbacks;
+     }
+ };
 
-                 newDistZombie =
-                     sqrt(((another_animal->get_pos_x() - an_animal->get_pos_x()) *
-                         (another_animal->get_pos_x() - an_animal->get_pos_x())) +
-                         ((another_animal->get_pos_y() - an_animal->get_pos_y()) *
-                             (another_animal->get_pos_y() - an_animal->get_pos_y())));
+ void ground::drawBackground() {
+     this->backend_->clear(
+         this->halloween_ ? this->background_halloween_ : this->background_);
+ };
 
-                 if ((newDistZombie < 200) && (newDistZombie < distZombie)) {
-                     distZombie = newDistZombie;
-                     zombie = another_animal;
-                 }
-             }
-             else if (another_animal->getProperties()[0] == "wolf") {
+ // The camera centers the sheperd and stays in the world
+ void ground::followSheperd() {
+     if (!this->sheperd_) {
+         return;
+     }
+     const premultipliedImage& sprite =
+         spriteBank::get().premultiplied(this->sheperd_->get_sprite());
+     this->camera_x_ = cameraAxis(this->sheperd_->get_pos_x() + sprite.w / 2,
+         frame_width / this->zoom_, this->world_width_);
+     this->camera_y_ = cameraAxis(this->sheperd_->get_pos_y() + sprite.h / 2,
+         frame_height / this->zoom_, this->world_height_);
+ };
 
-                 newDistLoup =
-                     sqrt(((another_animal->get_pos_x() - an_animal->get_pos_x()) *
-                         (another_animal->get_pos_x() - an_animal->get_pos_x())) +
-                         ((another_animal->get_pos_y() - an_animal->get_pos_y()) *
-                             (another_animal->get_pos_y() - an_animal->get_pos_y())));
+ // The draw of a sprite of the world in the window, at the level of the
+ // zoom, false when it is out of the window
+ bool ground::project(int sprite, int pos_x, int pos_y, spriteDraw& draw) const {
+     spriteBank& bank = spriteBank::get();
+     draw.sprite = bank.scaled(sprite, this->zoom_);
+     draw.x = (int)floor((pos_x - this->camera_x_) * this->zoom_);
+     draw.y = (int)floor((pos_y - this->camera_y_) * this->zoom_);
+     const premultipliedImage& image = bank.premultiplied(draw.sprite);
+     return !offScreen(draw.x, draw.y, image.w, image.h);
+ };
 
-                 if ((newDistLoup < 200) && (newDistLoup < distLoup)) {
-                     distLoup = newDistLoup;
-                     loup = another_animal;
-                 }
+ // The render list is in window coordinates. Sorted by sprite with a
+ // counting sort, stable so that the draws of one sprite keep the order of
+ // the zoo
+ void ground::buildRenderList(std::vector<spriteDraw>& draws) {
+     this->unsorted_.clear();
+     this->followSheperd();
+     bool crowds = this->crowd_density_ > 0 && this->markCrowds();
+     for (size_t i = 0; i < this->the_zoo.size(); i++) {
+         auto& an_animal = this->the_zoo[i];
+         if (this->inTick(i)) {
+             if (!crowds) {
+                 an_animal->syncPosition();
              }
-             else if ((another_animal->getProperties()[0] == "sheep") &&
-                 (an_animal->getProperties()[1] == "male") &&
-                 (another_animal->getProperties()[1] == "female")) {
-                 newDistLove =
-                     sqrt(((another_animal->get_pos_x() - an_animal->get_pos_x()) *
-                         (another_animal->get_pos_x() - an_animal->get_pos_x())) +
-                         ((another_animal->get_pos_y() - an_animal->get_pos_y()) *
-                             (another_animal->get_pos_y() - an_animal->get_pos_y())));
-
-                 if (newDistLove < distLove) {
-                     distLove = newDistLove;
-                     moutone = another_animal;
-                 }
+             else if (this->crowd_tile_of_[i] >= 0 &&
+                 this->crowd_counts_[this->crowd_tile_of_[i]] > 0) {
+                 continue;
              }
-         }
-         if (zombie != nullptr) {
-             an_animal->interact(zombie);
-         }
-         else if (loup != nullptr) {
-             an_animal->interact(loup);
-         }
-         else if (moutone != nullptr) {
-             if (an_animal->interact(moutone)) {
-                 std::string couleurp = an_animal->getProperties()[4];
-                 std::string couleurm = moutone->getProperties()[4];
-                 if ((couleurp == "white" || couleurm == "white") &&
-                     (couleurm == "red" || couleurp == "red")) {
-                     this->add_animal(
-                         std::make_shared<sheep>(window_surface_ptr_, moutone->get_pos_x(),
-                             moutone->get_pos_y(), 0, 0, "pink"));
-                 }
-                 else if ((couleurp == "blue" || couleurm == "blue") &&
-                     (couleurm == "red" || couleurp == "red")) {
-                     this->add_animal(
-                         std::make_shared<sheep>(window_surface_ptr_, moutone->get_pos_x(),
-                             moutone->get_pos_y(), 0, 0, "purple"));
-                 }
-                 else if ((couleurp == "yellow" || couleurm == "yellow") &&
-                     (couleurm == "red" || couleurp == "red")) {
-                     this->add_animal(
-                         std::make_shared<sheep>(window_surface_ptr_, moutone->get_pos_x(),
-                             moutone->get_pos_y(), 0, 0, "orange"));
-                 }
-                 else if ((couleurp == "blue" || couleurm == "blue") &&
-                     (couleurm == "yellow" || couleurp == "yellow")) {
-                     this->add_animal(
-                         std::make_shared<sheep>(window_surface_ptr_, moutone->get_pos_x(),
-                             moutone->get_pos_y(), 0, 0, "green"));
-                 }
-                 else {
-                     if (std::rand() % 2 == 0) {
-                         this->add_animal(std::make_shared<sheep>(
-                             window_surface_ptr_, moutone->get_pos_x(), moutone->get_pos_y(),
-                             0, 0, couleurp));
-                     }
-                     else {
-                         this->add_animal(std::make_shared<sheep>(
-                             window_surface_ptr_, moutone->get_pos_x(), moutone->get_pos_y(),
-                             0, 0, couleurm));
-                     }
-                 }
+             spriteDraw draw;
+             if (!this->project(an_animal->get_sprite(), an_animal->get_pos_x(),
+                 an_animal->get_pos_y(), draw)) {
+                 this->culled_++;
+                 continue;
              }
+             this->unsorted_.push_back(draw);
          }
-
      }
-     else if (an_animal->getProperties()[0] == "wolf") {
-         unsigned int distMout = INT16_MAX;
-         unsigned int newDistMout = 0;
-         unsigned int distDog = INT16_MAX;
-         unsigned int newDistDog = 0;
-         unsigned int distZombie = INT16_MAX;
-         unsigned int newDistZombie = 0;
-         std::shared_ptr<interactiveObject> mouton = nullptr;
-         std::shared_ptr<interactiveObject> dog = nullptr;
-         std::shared_ptr<interactiveObject> zombie = nullptr;
-
-         for (auto& another_animal : this->the_zoo) {
-             if (another_animal->getProperties()[0] == "zombie") {
-
-                 newDistZombie =
-                     sqrt(((another_animal->get_pos_x() - an_animal->get_pos_x()) *
-                         (another_animal->get_pos_x() - an_animal->get_pos_x())) +
-                         ((another_animal->get_pos_y() - an_animal->get_pos_y()) *
-                             (another_animal->get_pos_y() - an_animal->get_pos_y())));
-
-                 if ((newDistZombie < 200) && (newDistZombie < distZombie)) {
-                     distZombie = newDistZombie;
-                     zombie = another_animal;
-                 }
-             }
-             else if (another_animal->getProperties()[0] == "sheep") {
-
-                 newDistMout =
-                     sqrt(((another_animal->get_pos_x() - an_animal->get_pos_x()) *
-                         (another_animal->get_pos_x() - an_animal->get_pos_x())) +
-                         ((another_animal->get_pos_y() - an_animal->get_pos_y()) *
-                             (another_animal->get_pos_y() - an_animal->get_pos_y())));
+     this->render_frames_++;
+     if (crowds) {
+         this->addImpostors();
+     }
+     size_t starts[spriteBank::max_sprites + 1] = {};
+     for (const auto& draw : this->unsorted_) {
+         starts[draw.sprite + 1]++;
+     }
+     for (size_t sprite = 1; sprite <= spriteBank::max_sprites; sprite++) {
+         starts[sprite] += starts[sprite - 1];
+     }
+     draws.resize(this->unsorted_.size());
+     for (const auto& draw : this->unsorted_) {
+         draws[starts[draw.sprite]++] = draw;
+     }
+ };
 
-                 if (newDistMout < distMout) {
-                     distMout = newDistMout;
-                     mouton = another_animal;
-                 }
-             }
-             else if (another_animal->getProperties()[0] == "dog") {
-                 newDistDog =
-                     sqrt(((another_animal->get_pos_x() - an_animal->get_pos_x()) *
-                         (another_animal->get_pos_x() - an_animal->get_pos_x())) +
-                         ((another_animal->get_pos_y() - an_animal->get_pos_y()) *
-                             (another_animal->get_pos_y() - an_animal->get_pos_y())));
-
-                 if ((newDistDog < 300) && (newDistDog < distDog)) {
-                     distDog = newDistDog;
-                     dog = another_animal;
-                 }
-             }
+ // Counts the animals of every tile by the center of their sprite, leaving
+ // out the ones out of the window or near the sheperd or the cursor. Only the counts of the tiles
+ // drawn as crowds are kept, false when there is none.
+ bool ground::markCrowds() {
+     int focus_x[2];
+     int focus_y[2];
+     int focuses = 1;
+     focus_x[0] = this->cursor_x_;
+     focus_y[0] = this->cursor_y_;
+     if (this->sheperd_) {
+         focus_x[focuses] = (int)((this->sheperd_->get_pos_x() - this->camera_x_) * this->zoom_);
+         focus_y[focuses] = (int)((this->sheperd_->get_pos_y() - this->camera_y_) * this->zoom_);
+         focuses++;
+     }
+     spriteBank& bank = spriteBank::get();
+     std::fill(this->crowd_counts_.begin(), this->crowd_counts_.end(), 0);
+     this->crowd_tile_of_.assign(this->the_zoo.size(), -1);
+     size_t alive = 0;
+     for (size_t i = 0; i < this->the_zoo.size(); i++) {
+         auto& an_animal = this->the_zoo[i];
+         if (!this->inTick(i)) {
+             continue;
+         }
+         an_animal->syncPosition();
+         alive++;
+         spriteDraw draw;
+         if (!this->project(an_animal->get_sprite(), an_animal->get_pos_x(),
+             an_animal->get_pos_y(), draw)) {
+             continue;
          }
-         if (zombie != nullptr) {
-             an_animal->interact(zombie);
+         const premultipliedImage& sprite = bank.premultiplied(draw.sprite);
+         int x = draw.x + sprite.w / 2;
+         int y = draw.y + sprite.h / 2;
+         bool focused = false;
+         for (int f = 0; f < focuses; f++) {
+             long long dx = x - focus_x[f];
+             long long dy = y - focus_y[f];
+             focused = focused || dx * dx + dy * dy <= (long long)crowd_focus * crowd_focus;
          }
-         else if (dog != nullptr) {
-             an_animal->interact(dog);
+         if (focused) {
+             continue;
          }
-         else if (mouton != nullptr) {
-             an_animal->interact(mouton);
+         int tile = std::clamp(y / crowd_tile, 0, this->crowd_rows_ - 1) * this->crowd_columns_ +
+             std::clamp(x / crowd_tile, 0, this->crowd_columns_ - 1);
+         this->crowd_tile_of_[i] = tile;
+         if (this->crowd_counts_[tile]++ == 0) {
+             this->crowd_sprite_[tile] = draw.sprite;
          }
      }
-     else if (an_animal->getProperties()[0] == "dog") {
-         unsigned int distZombie = INT16_MAX;
-         unsigned int newDistZombie = 0;
-         unsigned int distSheperd = INT16_MAX;
-         unsigned int newDistSheperd = 0;
-         std::shared_ptr<interactiveObject> zombie = nullptr;
-         std::shared_ptr<interactiveObject> sheperd = nullptr;
-         for (auto& another_animal : this->the_zoo) {
-             if (another_animal->getProperties()[0] == "zombie") {
-
-                 newDistZombie =
-                     sqrt(((another_animal->get_pos_x() - an_animal->get_pos_x()) *
-                         (another_animal->get_pos_x() - an_animal->get_pos_x())) +
-                         ((another_animal->get_pos_y() - an_animal->get_pos_y()) *
-                             (another_animal->get_pos_y() - an_animal->get_pos_y())));
+     int least = alive > this->crowd_population_ ? 2 : (int)this->crowd_density_;
+     bool any = false;
+     for (auto& count : this->crowd_counts_) {
+         if (count < least) {
+             count = 0;
+         }
+         any = any || count > 0;
+     }
+     return any;
+ };
 
-                 if ((newDistZombie < 200) && (newDistZombie < distZombie)) {
-                     distZombie = newDistZombie;
-                     zombie = another_animal;
-                 }
-             }
-             else if (another_animal->getProperties()[0] == "sheperd") {
-                 newDistSheperd =
-                     sqrt(((another_animal->get_pos_x() - an_animal->get_pos_x()) *
-                         (another_animal->get_pos_x() - an_animal->get_pos_x())) +
-                         ((another_animal->get_pos_y() - an_animal->get_pos_y()) *
-                             (another_animal->get_pos_y() - an_animal->get_pos_y())));
-
-                 if ((newDistSheperd < 200) && (newDistSheperd < distSheperd)) {
-                     distSheperd = newDistSheperd;
-                     sheperd = another_animal;
-                 }
-             }
-             if (zombie != nullptr) {
-                 an_animal->interact(zombie);
-             }
-             else if (sheperd != nullptr) {
-                 an_animal->interact(sheperd);
-             }
+ // A patch by crowd, twice as many animals for each darker level
+ void ground::addImpostors() {
+     spriteBank& bank = spriteBank::get();
+     for (int tile = 0; tile < (int)this->crowd_counts_.size(); tile++) {
+         int count = this->crowd_counts_[tile];
+         if (count == 0) {
+             continue;
          }
+         int level = 0;
+         for (int n = count; n >= 4 && level < crowd_levels - 1; n /= 2) {
+             level++;
+         }
+         int x = (tile % this->crowd_columns_) * crowd_tile;
+         int y = (tile / this->crowd_columns_) * crowd_tile;
+         this->unsorted_.push_back({ this->crowd_patches_[level], x, y });
+         const premultipliedImage& sprite = bank.premultiplied(this->crowd_sprite_[tile]);
+         this->unsorted_.push_back({ this->crowd_sprite_[tile],
+             x + (crowd_tile - sprite.w) / 2, y + (crowd_tile - sprite.h) / 2 });
+         this->crowd_tiles_++;
+         this->crowd_hidden_ += count - 1;
      }
-     else if (an_animal->getProperties()[0] == "zombie") {
-         unsigned int distTarget = INT16_MAX;
-         unsigned int newDistTarget = 0;
-         std::shared_ptr<interactiveObject> target = nullptr;
-         for (auto& another_animal : this->the_zoo) {
-             if (another_animal->getProperties()[0] != "zombie") {
+     this->crowd_frames_++;
+ };
 
-                 newDistTarget =
-                     sqrt(((another_animal->get_pos_x() - an_animal->get_pos_x()) *
-                         (another_animal->get_pos_x() - an_animal->get_pos_x())) +
-                         ((another_animal->get_pos_y() - an_animal->get_pos_y()) *
-                             (another_animal->get_pos_y() - an_animal->get_pos_y())));
+ void ground::blitRenderList() {
+     this->backend_->draw(this->draws_.data(), this->draws_.size());
+ };
+
+ // The tiles are dealt out in turn, the crowds being often on a few of them
+ void ground::drawTiles(unsigned chunk, unsigned chunks) {
+     for (int tile = chunk; tile < this->tiles_.size(); tile += chunks) {
+         this->backend_->drawTile(this->tiles_.rect(tile), this->tiles_.entries(tile),
+             this->tiles_.count(tile));
+     }
+ };
 
-                 if ((newDistTarget < 200) && (newDistTarget < distTarget)) {
-                     distTarget = newDistTarget;
-                     target = another_animal;
+ void ground::interract(const std::shared_ptr<interactiveObject>& an_animal,
+     intentList& intents) {
+     // Only the state saved at the start of the tick is read, so the result
+     // does not depend on the order of the zoo
+     const entityState& self = an_animal->getPrevious();
+     const pairReach& reach = reachOf(self);
+     const unsigned long long now = this->timers_.now();
+     const int self_x = self.x(now);
+     const int self_y = self.y(now);
+     for (int rank = 0; rank < rule_ranks; rank++) {
+         nearSlot nearest = { LLONG_MAX, -1 };
+         for (const nearSlot* slots : this->near_) {
+             const nearSlot& slot = slots[self.index * rule_ranks + rank];
+             if (slot.dist < nearest.dist ||
+                 (slot.dist == nearest.dist && slot.index < nearest.index)) {
+                 nearest = slot;
+             }
+         }
+         // Nothing within the pair radius: a rule reaching anywhere looks
+         // at the whole field, or at the herds, which give the same nearest
+         // since nothing is nearer than the radius. An idle sheep only flees:
+         // a male on a path is in his cooldown.
+         if (nearest.index < 0 && reach.unbounded[rank] && !an_animal->idle()) {
+             nearSlot far[rule_ranks];
+             std::fill(std::begin(far), std::end(far), nearSlot{ LLONG_MAX, -1 });
+             auto offer = [&](const entityState& another_animal) {
+                 if (&another_animal != &self) {
+                     long long dx = another_animal.x(now) - self_x;
+                     long long dy = another_animal.y(now) - self_y;
+                     offerNearest(reach, another_animal, dx * dx + dy * dy, far);
+                 }
+             };
+             if (this->use_herds_ && reach.herded[rank]) {
+                 this->herds_.search(self_x, self_y,
+                     [&] { return far[rank].dist; },
+                     [&](int index) { offer(this->the_zoo[index]->getPrevious()); });
+             }
+             else {
+                 for (const auto& another_animal : this->the_zoo) {
+                     offer(another_animal->getPrevious());
                  }
              }
+             nearest = far[rank];
          }
-         if (target != nullptr) {
-             an_animal->interact(target);
+         if (nearest.index >= 0) {
+             an_animal->interact(this->the_zoo[nearest.index]->getPrevious(), intents);
+             return;
          }
      }
  };
 
  void ground::moveSheperd(SDL_Event& window_event) {
-     std::string lettre = SDL_GetKeyName(window_event.key.keysym.sym);
-     for (auto& interObject : the_zoo) {
-         if (interObject->getProperties()[0] == "sheperd") {
-             switch (window_event.type) {
-             case SDL_KEYDOWN:
-                 if (lettre == "Z") {
-                     interObject->setVit_y(-150);
-                 }
-                 else if (lettre == "Q") {
-                     interObject->setVit_x(-150);
-                 }
-                 else if (lettre == "S") {
-                     interObject->setVit_y(150);
-                 }
-                 else if (lettre == "D") {
-                     interObject->setVit_x(150);
-                 }
-                 break;
-             case SDL_KEYUP:
-                 if (lettre == "Z") {
-                     interObject->setVit_y(0);
-                 }
-                 else if (lettre == "Q") {
-                     interObject->setVit_x(0);
-                 }
-                 else if (lettre == "S") {
-                     interObject->setVit_y(0);
-                 }
-                 else if (lettre == "D") {
-                     interObject->setVit_x(0);
-                 }
-                 break;
-             }
+     // SDL_GetKeyName(SDLK_z) is "Z": comparing the key codes gives the same
+     // keys without building a string per event
+     SDL_Keycode lettre = window_event.key.keysym.sym;
+     // Nothing to move once the sheperd is eaten
+     if (!this->sheperd_) {
+         return;
+     }
+     switch (window_event.type) {
+     case SDL_KEYDOWN:
+         if (lettre == SDLK_z) {
+             this->sheperd_->setVit_y(-150);
+         }
+         else if (lettre == SDLK_q) {
+             this->sheperd_->setVit_x(-150);
+         }
+         else if (lettre == SDLK_s) {
+             this->sheperd_->setVit_y(150);
+         }
+         else if (lettre == SDLK_d) {
+             this->sheperd_->setVit_x(150);
+         }
+         break;
+     case SDL_KEYUP:
+         if (lettre == SDLK_z) {
+             this->sheperd_->setVit_y(0);
+         }
+         else if (lettre == SDLK_q) {
+             this->sheperd_->setVit_x(0);
+         }
+         else if (lettre == SDLK_s) {
+             this->sheperd_->setVit_y(0);
+         }
+         else if (lettre == SDLK_d) {
+             this->sheperd_->setVit_x(0);
          }
+         break;
      }
  };
 
+ // The hit is applied at the start of the next tick, like any intent
  void ground::clickButton(SDL_Event& window_event) {
-     int x = window_event.button.x;
-     int y = window_event.button.y;
-     std::shared_ptr<interactiveObject> sheperd;
+     int x = this->camera_x_ + (int)(window_event.button.x / this->zoom_);
+     int y = this->camera_y_ + (int)(window_event.button.y / this->zoom_);
+     int sheperd = this->sheperd_index_;
 
-     for (auto& an_animal : this->the_zoo) {
-         if (an_animal->getProperties()[0] == "sheperd") {
-             sheperd = an_animal;
-         }
+     // The sheperd can be eaten between the click and this tick
+     if (sheperd < 0) {
+         return;
      }
+     int sheperd_x = this->sheperd_->get_pos_x();
+     int sheperd_y = this->sheperd_->get_pos_y();
      int distZombie = INT16_MAX;
-     for (auto& an_animal : this->the_zoo) {
+     for (size_t i = 0; i < this->the_zoo.size(); i++) {
+         auto& an_animal = this->the_zoo[i];
          if (an_animal->getProperties()[0] == "zombie") {
-             distZombie = sqrt(((sheperd->get_pos_x() - an_animal->get_pos_x()) *
-                 (sheperd->get_pos_x() - an_animal->get_pos_x())) +
-                 ((sheperd->get_pos_y() - an_animal->get_pos_y()) *
-                     (sheperd->get_pos_y() - an_animal->get_pos_y())));
+             distZombie = distance(sheperd_x, sheperd_y, an_animal->get_pos_x(),
+                 an_animal->get_pos_y());
              if (an_animal->get_pos_x() <= x && x <= an_animal->get_pos_x() + 67 && an_animal->get_pos_y() <= y && y <= an_animal->get_pos_y() + 71 && distZombie <= 100 && an_animal->getProperties()[5] == "false") {
-                 an_animal->getProperties()[5] = "true";
-                 an_animal->interact(sheperd);
+                 this->input_intents_.push_back({ intent::hit, sheperd, (int)i });
              }
          }
      }
      
  };
 
- int ground::getScore() {
-     int score = 0;
-     for (const auto an_animal : the_zoo) {
-         if (an_animal->getProperties()[0] == "sheep") {
-             score++;
+ void ground::moveCursor(SDL_Event& window_event) {
+     this->cursor_x_ = window_event.motion.x;
+     this->cursor_y_ = window_event.motion.y;
+ };
+
+ // Each notch of the wheel zooms in or out by a quarter
+ void ground::zoomView(SDL_Event& window_event) {
+     if (window_event.wheel.y > 0) {
+         this->setZoom(this->zoom_ * 1.25);
+     }
+     else if (window_event.wheel.y < 0) {
+         this->setZoom(this->zoom_ / 1.25);
+     }
+ };
+
+ void ground::setZoom(double zoom) {
+     double whole = std::min((double)frame_width / this->world_width_,
+         (double)frame_height / this->world_height_);
+     this->zoom_ = std::clamp(zoom, std::min(whole, 1.), 1.);
+ };
+
+ void ground::setLateSheperd(bool late_sheperd) {
+     this->late_sheperd_ = late_sheperd;
+ };
+
+ // Moves and draws the sheperd on top of the world update()
+ // already drew, right before the present
+ void ground::updateSheperd() {
+     if (this->sheperd_ && this->sheperd_->isAlive()) {
+         this->sheperd_->move();
+         spriteDraw draw;
+         if (this->project(this->sheperd_->get_sprite(), this->sheperd_->get_pos_x(),
+             this->sheperd_->get_pos_y(), draw)) {
+             this->backend_->draw(&draw, 1);
          }
      }
-     return score;
+ };
+
+ // The dead animals leave the zoo before the rules are checked, so the
+ // counts of the population are the living ones
+ int ground::getScore() {
+     return (int)this->population_.count(species::sheep);
  };
 
  bool ground::isSheperdAlive() {
-     for (int i = 0; i < the_zoo.size(); i++) {
-         if (the_zoo[i]->getProperties()[0] == "sheperd") {
-             if (the_zoo[i]->getProperties()[3] == "alive") {
-                 return true;
+     return this->sheperd_ != nullptr;
+ }
+
+ framePacer::framePacer(double period)
+     : frequency_{ SDL_GetPerformanceFrequency() },
+     period_{ (Uint64)(period * SDL_GetPerformanceFrequency()) },
+     spin_margin_{ SDL_GetPerformanceFrequency() / 500 }, start_{ 0 },
+     frame_start_{ 0 }, next_deadline_{ 0 }, tail_{ 0 }, present_deadline_{ 0 },
+     frames_{ 0 }, missed_{ 0 }, drift_{ 0 }, max_work_{ 0 }, max_late_{ 0 },
+     jitter_sum_{ 0. }, max_jitter_{ 0 }, late_presents_{ 0 }, max_tail_{ 0 } {};
+
+ void framePacer::start() {
+     this->start_ = SDL_GetPerformanceCounter();
+     this->frame_start_ = this->start_;
+     this->next_deadline_ = this->start_ + this->period_;
+ };
+
+ // The wait ends tail_ before the deadline, 0 unless presented() is called
+ void framePacer::wait() {
+     Uint64 now = SDL_GetPerformanceCounter();
+     Uint64 work = now - this->frame_start_;
+     if (work > this->max_work_) {
+         this->max_work_ = work;
+     }
+
+     Uint64 target = this->next_deadline_ - this->tail_;
+     if (now >= target) {
+         // The update and the present did not fit in the frame: no sleep.
+         // More than a period behind, the lost frames are dropped instead of
+         // being run back to back.
+         Uint64 late = now - target;
+         this->missed_++;
+         this->drift_ += late;
+         if (late > this->max_late_) {
+             this->max_late_ = late;
+         }
+         if (late >= this->period_) {
+             this->next_deadline_ = now + this->tail_;
+         }
+     }
+     else {
+         Uint64 remaining = target - now;
+         Uint64 half_ms = this->frequency_ / 2000;
+         if (remaining > this->spin_margin_) {
+             Uint32 ms = (Uint32)((remaining - this->spin_margin_) * 1000 /
+                 this->frequency_);
+             if (ms > 0) {
+                 Uint64 before = SDL_GetPerformanceCounter();
+                 SDL_Delay(ms);
+                 Uint64 slept = SDL_GetPerformanceCounter() - before;
+                 Uint64 asked = (Uint64)ms * this->frequency_ / 1000;
+                 Uint64 over = (slept > asked ? slept - asked : 0) + half_ms;
+                 // Grow at once on a big oversleep, shrink slowly
+                 if (over > this->spin_margin_) {
+                     this->spin_margin_ = std::min(over, this->period_ / 2);
+                 }
+                 else {
+                     this->spin_margin_ -= (this->spin_margin_ - over) / 16;
+                 }
              }
          }
+         while ((now = SDL_GetPerformanceCounter()) < target) {
+         }
+         Uint64 late = now - target;
+         this->drift_ += late;
+         if (late > this->max_late_) {
+             this->max_late_ = late;
+         }
      }
-     return false;
- }
 
- application::application(unsigned n_sheep, unsigned n_wolf)
+     Uint64 interval = now - this->frame_start_;
+     Uint64 jitter = interval > this->period_ ? interval - this->period_
+         : this->period_ - interval;
+     this->jitter_sum_ += jitter;
+     if (jitter > this->max_jitter_) {
+         this->max_jitter_ = jitter;
+     }
+
+     this->frames_++;
+     this->frame_start_ = now;
+     this->present_deadline_ = this->next_deadline_;
+     this->next_deadline_ += this->period_;
+ };
+
+ // The tail after the wait is learnt like the spin margin, with a quarter
+ // more for the jitter of the present: at once when it grows, slowly when
+ // it shrinks
+ void framePacer::presented() {
+     Uint64 now = SDL_GetPerformanceCounter();
+     Uint64 tail = now - this->frame_start_;
+     if (tail > this->max_tail_) {
+         this->max_tail_ = tail;
+     }
+     if (now > this->present_deadline_) {
+         this->late_presents_++;
+     }
+     Uint64 wanted = tail + tail / 4;
+     if (wanted > this->tail_) {
+         this->tail_ = std::min(wanted, this->period_ / 2);
+     }
+     else {
+         this->tail_ -= (this->tail_ - wanted) / 16;
+     }
+ };
+
+ double framePacer::toMs(Uint64 ticks) const {
+     return 1000. * ticks / this->frequency_;
+ };
+
+ double framePacer::elapsed() const {
+     return (double)(SDL_GetPerformanceCounter() - this->start_) /
+         this->frequency_;
+ };
+
+ void framePacer::report() const {
+     if (this->frames_ == 0) {
+         return;
+     }
+     std::cout << "Frames : " << this->frames_
+         << ", deadlines missed : " << this->missed_
+         << ", drift : " << this->toMs(this->drift_) << " ms" << std::endl;
+     std::cout << "Worst frame work : " << this->toMs(this->max_work_)
+         << " ms, worst lateness : " << this->toMs(this->max_late_)
+         << " ms" << std::endl;
+     std::cout << "Jitter : mean " << this->jitter_sum_ * 1000. /
+         this->frequency_ / this->frames_
+         << " ms, max " << this->toMs(this->max_jitter_) << " ms" << std::endl;
+     if (this->max_tail_ > 0) {
+         std::cout << "Present after the wait : worst " << this->toMs(this->max_tail_)
+             << " ms, " << this->late_presents_ << " past the deadline" << std::endl;
+     }
+ };
+
+ latencyTracker::latencyTracker() : seq_{ 0 } {
+     this->pending_.reserve(64);
+     this->from_event_.reserve(1024);
+     this->from_poll_.reserve(1024);
+ };
+
+ unsigned latencyTracker::input(const SDL_Event& event) {
+     this->seq_++;
+     this->pending_.push_back(
+         { event.common.timestamp, SDL_GetPerformanceCounter(), this->seq_ });
+     return this->seq_;
+ };
+
+ void latencyTracker::presented() { this->presented(this->seq_); };
+
+ void latencyTracker::presented(unsigned last_seq) {
+     if (this->pending_.empty()) {
+         return;
+     }
+     Uint32 now_ms = SDL_GetTicks();
+     Uint64 now = SDL_GetPerformanceCounter();
+     double frequency = (double)SDL_GetPerformanceFrequency();
+     size_t shown = 0;
+     // pending_ is in sequence order
+     while (shown < this->pending_.size() && this->pending_[shown].seq <= last_seq) {
+         const auto& input = this->pending_[shown];
+         this->from_event_.push_back((double)(now_ms - input.queued));
+         this->from_poll_.push_back(1000. * (now - input.polled) / frequency);
+         shown++;
+     }
+     this->pending_.erase(this->pending_.begin(), this->pending_.begin() + shown);
+ };
+
+ void latencyTracker::report() const {
+     if (this->from_event_.empty()) {
+         return;
+     }
+     std::cout << "Input latency over " << this->from_event_.size()
+         << " events" << std::endl;
+     printDurations("  event -> present", this->from_event_);
+     printDurations("  poll -> present", this->from_poll_);
+ };
+
+ application::application(unsigned n_sheep, unsigned n_wolf,
+     const appOptions& options)
      : window_ptr_{ SDL_CreateWindow("SDL2 Window", SDL_WINDOWPOS_CENTERED,
                                     SDL_WINDOWPOS_CENTERED, frame_width,
                                     frame_height, 0) },
-     window_surface_ptr_{ SDL_GetWindowSurface(window_ptr_) },
-     ground_{ std::make_shared<ground>(window_surface_ptr_) }, n_wolf_{ n_wolf },
-     n_sheep_{ n_sheep } {
+     backend_{ window_ptr_ ? makeRenderBackend(options.render, window_ptr_) : nullptr },
+     ground_{ std::make_shared<ground>(backend_.get(), options.world_width,
+         options.world_height) }, n_wolf_{ n_wolf },
+     n_sheep_{ n_sheep }, options_{ options }, stop_{ false } {
      if (!window_ptr_)
          throw std::runtime_error(std::string(SDL_GetError()));
 
-     if (!window_surface_ptr_)
-         throw std::runtime_error(std::string(SDL_GetError()));
-
      std::srand(time(NULL));
+     sheep::setPlannedMotion(options.planned_motion);
+     movingObject::setWorld(options.world_width, options.world_height);
 
      for (int i = 0; i < n_sheep; i++) {
-         this->ground_->add_animal(std::make_shared<sheep>(window_surface_ptr_));
+         this->ground_->add_animal(std::make_shared<sheep>());
      }
 
      for (int i = 0; i < n_wolf; i++) {
-         this->ground_->add_animal(std::make_shared<wolf>(window_surface_ptr_));
+         this->ground_->add_animal(std::make_shared<wolf>());
      }
 
-     std::shared_ptr<sheperd> maitre =
-         std::make_shared<sheperd>(window_surface_ptr_);
+     std::shared_ptr<sheperd> maitre = std::make_shared<sheperd>();
      this->ground_->add_animal(maitre);
-     this->ground_->add_animal(std::make_shared<dog>(window_surface_ptr_, maitre));
+     this->ground_->add_animal(std::make_shared<dog>(maitre));
+
+     // Every sheep eaten before halloween comes back as a zombie
+     this->ground_->prebuildZombies(n_sheep);
+     this->ground_->setPopulationCaps(
+         { options.sheep_soft_cap, options.sheep_hard_cap },
+         { options.zombie_soft_cap, options.zombie_hard_cap });
+
+     this->ground_->useHerds(options.herds);
+     this->ground_->setCrowd(options.crowd_population, options.crowd_density);
+     this->ground_->setZoom(options.zoom);
+     allocGuard::setStrict(options.alloc_strict);
+     if (options.tasks) {
+         unsigned threads = std::max(2u, std::thread::hardware_concurrency());
+         this->executor_ = std::make_unique<taskExecutor>(threads - 1);
+         this->ground_->useTaskGraph(this->executor_.get());
+     }
  };
 
  application::~application() {
+     this->ground_->useTaskGraph(nullptr);
+     this->backend_.reset();
      SDL_DestroyWindow(window_ptr_);
      window_ptr_ = nullptr;
-     SDL_FreeSurface(window_surface_ptr_);
-     window_surface_ptr_ = nullptr;
+ };
+
+ void application::reportStats() const {
+     this->latency_.report();
+     this->backend_->report();
+     this->ground_->report();
+     allocGuard::report();
+ };
+
+ // The cursor is only read by the crowds: its moves are not timed and only
+ // the last one of the frame is forwarded
+ bool application::pollEvents() {
+     SDL_Event motion = {};
+     bool moved = false;
+     while (SDL_PollEvent(&window_event_) > 0) {
+         switch (window_event_.type) {
+         case SDL_KEYDOWN:
+         case SDL_KEYUP:
+         case SDL_MOUSEBUTTONDOWN:
+         case SDL_MOUSEWHEEL:
+             this->forwardEvent(window_event_, this->latency_.input(window_event_));
+             break;
+         case SDL_MOUSEMOTION:
+             motion = window_event_;
+             moved = true;
+             break;
+         case SDL_WINDOWEVENT:
+             if (window_event_.window.event == SDL_WINDOWEVENT_EXPOSED ||
+                 window_event_.window.event == SDL_WINDOWEVENT_RESTORED ||
+                 window_event_.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+                 this->backend_->invalidate();
+             }
+             break;
+         case SDL_QUIT:
+             return false;
+         }
+     }
+     if (moved) {
+         this->forwardEvent(motion, 0);
+     }
+     return true;
+ };
+
+ void application::forwardEvent(const SDL_Event& event, unsigned seq) {
+     if (this->options_.pipeline) {
+         // The simulation thread empties the queue every frame
+         while (!this->inputs_.push({ event, seq })) {
+             std::this_thread::yield();
+         }
+     }
+     else {
+         SDL_Event applied = event;
+         this->applyEvent(applied);
+     }
+ };
+
+ void application::applyEvent(SDL_Event& event) {
+     switch (event.type) {
+     case SDL_KEYDOWN:
+         this->ground_->moveSheperd(event);
+         break;
+     case SDL_KEYUP:
+         this->ground_->moveSheperd(event);
+         break;
+     case SDL_MOUSEBUTTONDOWN:
+         this->ground_->clickButton(event);
+         break;
+     case SDL_MOUSEWHEEL:
+         this->ground_->zoomView(event);
+         break;
+     case SDL_MOUSEMOTION:
+         this->ground_->moveCursor(event);
+         break;
+     }
+ };
+
+ application::gameStatus application::checkRules(unsigned period) {
+     if (this->ground_->getScore() == 0) {
+         return no_sheep;
+     }
+     if (SDL_GetTicks() >= 1000u * floor(period/2) && !this->ground_->get_Haloween()) {
+         this->ground_->true_halloween();
+         std::cout << "Attention le jeu n'est pas fini !" << std::endl;
+         std::cout << "Survivez aux moutons zombie !" << std::endl;
+     }
+     if (!this->ground_->isSheperdAlive()) {
+         return sheperd_dead;
+     }
+     return running;
+ };
+
+ void application::simulate(unsigned period) {
+     framePacer pacer(frame_time);
+     unsigned input_seq = 0;
+     gameStatus status = time_over;
+     pacer.start();
+     while (!this->stop_.load() && SDL_GetTicks() <= 1000u * period) {
+         allocGuard::enter(allocGuard::update);
+         inputEvent input;
+         while (this->inputs_.pop(input)) {
+             this->applyEvent(input.event);
+             // The moves of the cursor are not timed
+             if (input.seq != 0) {
+                 input_seq = input.seq;
+             }
+         }
+         status = this->checkRules(period);
+         if (status != running) {
+             break;
+         }
+         this->ground_->step();
+         renderSnapshot& snapshot = this->snapshots_.back();
+         this->ground_->fillSnapshot(snapshot);
+         snapshot.input_seq = input_seq;
+         snapshot.status = running;
+         this->snapshots_.publish();
+         allocGuard::enter(allocGuard::pacing);
+         pacer.wait();
+         status = time_over;
+     }
+     pacer.report();
+     // The last snapshot only carries the end of the game
+     this->snapshots_.back().status = status;
+     this->snapshots_.publish();
+ };
+
+ // The simulation runs on its own thread and publishes a snapshot per tick,
+ // this thread only polls the events, draws the latest snapshot and presents.
+ int application::loopPipeline(unsigned period) {
+     unsigned start_ticks = SDL_GetTicks();
+     int status = running;
+     bool quit = false;
+     this->stop_ = false;
+     std::thread simulation(&application::simulate, this, period);
+     while (status == running) {
+         allocGuard::enter(allocGuard::input);
+         if (!this->pollEvents()) {
+             quit = true;
+             break;
+         }
+         if (!this->snapshots_.update()) {
+             SDL_Delay(1);
+             continue;
+         }
+         allocGuard::enter(allocGuard::present);
+         const renderSnapshot& snapshot = this->snapshots_.front();
+         status = snapshot.status;
+         if (status != running) {
+             break;
+         }
+         this->backend_->clear(snapshot.background);
+         this->backend_->draw(snapshot.draws.data(), snapshot.draws.size());
+         this->backend_->present();
+         this->latency_.presented(snapshot.input_seq);
+         allocGuard::endFrame();
+     }
+     this->stop_ = true;
+     simulation.join();
+     this->reportStats();
+     if (quit) {
+         return 0;
+     }
+     unsigned seconds = (SDL_GetTicks() - start_ticks) / 1000;
+     if (status == sheperd_dead) {
+         std::cout << "Vous etes mort ! :(" << std::endl;
+         std::cout << "Perdu. Vous avez resiste " << seconds << " secondes." << std::endl;
+         return 0;
+     }
+     std::cout << "Vous avez survecu pendant " << seconds << " secondes." << std::endl;
+     std::cout << "Et vous avez garde en vie " << this->ground_->getScore()
+         << " moutons. Bravo !" << std::endl;
+     return 0;
  };
 
  int application::loop(unsigned period) {
+     if (this->options_.pipeline) {
+         return this->loopPipeline(period);
+     }
      unsigned start_ticks = SDL_GetTicks();
      unsigned last_ticks = SDL_GetTicks();
+     bool late_input = this->options_.late_input;
+     framePacer pacer(frame_time);
+     this->ground_->setLateSheperd(late_input);
+     pacer.start();
      while (SDL_GetTicks() <= 1000u * period) {
-         while (SDL_PollEvent(&window_event_) > 0) {
-             switch (window_event_.type) {
-             case SDL_KEYDOWN:
-                 this->ground_->moveSheperd(window_event_);
-                 break;
-             case SDL_KEYUP:
-                 this->ground_->moveSheperd(window_event_);
-                 break;
-             case SDL_MOUSEBUTTONDOWN:
-                 this->ground_->clickButton(window_event_);
-                 break;
-             case SDL_QUIT:
-                 return 0;
-             }
+         if (late_input) {
+             // The world is updated and drawn before the sleep, the input is
+             // sampled after it and only moves the sheperd before the present
+             allocGuard::enter(allocGuard::update);
+             this->ground_->update();
+             allocGuard::enter(allocGuard::pacing);
+             pacer.wait();
          }
-         if (this->ground_->getScore() == 0) {
-             break;
+         allocGuard::enter(allocGuard::input);
+         if (!this->pollEvents()) {
+             pacer.report();
+             this->reportStats();
+             return 0;
          }
-         if (SDL_GetTicks() >= 1000u * floor(period/2) && !this->ground_->get_Haloween()) {
-             this->ground_->true_halloween();
-             std::cout << "Attention le jeu n'est pas fini !" << std::endl;
-             std::cout << "Survivez aux moutons zombie !" << std::endl;
+         allocGuard::enter(allocGuard::rules);
+         gameStatus status = this->checkRules(period);
+         if (status == no_sheep) {
+             break;
          }
-         if (!this->ground_->isSheperdAlive()) {
+         if (status == sheperd_dead) {
              std::cout << "Vous etes mort ! :(" << std::endl;
              std::cout << "Perdu. Vous avez resiste "<<(last_ticks-start_ticks)/1000<<" secondes." << std::endl;
+             pacer.report();
+             this->reportStats();
              return 0;
          }
-         this->ground_->update();
-         unsigned nt = SDL_GetTicks();
-         if ((nt - last_ticks) < frame_time * 1000.)
-             SDL_Delay((unsigned)((frame_time * 1000.) - (nt - last_ticks)));
-         SDL_UpdateWindowSurface(window_ptr_);
+         allocGuard::enter(allocGuard::update);
+         if (late_input) {
+             this->ground_->updateSheperd();
+         }
+         else {
+             this->ground_->update();
+             this->ground_->startPrefetch();
+         }
+         // The present belongs to the frame: the pacer waits after it, or
+         // with late input ended its wait early enough for it
+         allocGuard::enter(allocGuard::present);
+         this->backend_->present();
+         this->ground_->finishPrefetch();
+         this->latency_.presented();
          last_ticks = SDL_GetTicks();
+         allocGuard::enter(allocGuard::pacing);
+         if (late_input) {
+             pacer.presented();
+         }
+         else {
+             pacer.wait();
+         }
+         allocGuard::endFrame();
      }
+     pacer.report();
+     this->reportStats();
      std::cout << "Vous avez survecu pendant " << (last_ticks - start_ticks)/1000 << " secondes." << std::endl;
      std::cout << "Et vous avez garde en vie " << this->ground_->getScore()
          << " moutons. Bravo !" << std::endl;
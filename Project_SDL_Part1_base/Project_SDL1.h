@@ -5,10 +5,18 @@
 
 #include <SDL.h>
 #include <SDL_image.h>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <thread>
+#include <utility>
 #include <vector>
 
 // Defintions
@@ -19,28 +27,125 @@ constexpr unsigned frame_height = 700; // Height of window in pixel
 // Minimal distance of animals to the border
 // of the screen
 constexpr unsigned frame_boundary = 100;
+// Zombies coming out of the corners at most per tick, and time they may take
+constexpr unsigned spawn_per_tick = 16;
+constexpr double spawn_budget_ms = 0.5;
 
 // Helper function to initialize SDL
 void init();
 
+// Options given on the command line after the three mandatory arguments
+struct appOptions {
+    bool late_input = false; // --late-input: sleep, then sample the input
+    bool pipeline = false;   // --pipeline: simulation on its own thread
+    bool tasks = false;      // --tasks: run each tick as a task graph
+    bool alloc_strict = false; // --alloc-strict: a frame that allocates after
+                               // warm-up ends the run (ALLOC_GUARD builds)
+    // --sheep-cap <soft> <hard> and --zombie-cap <soft> <hard>
+    size_t sheep_soft_cap = 2000;
+    size_t sheep_hard_cap = 4000;
+    size_t zombie_soft_cap = 2000;
+    size_t zombie_hard_cap = 4000;
+    bool herds = false; // --herds: the far searches for sheep go herd by herd
+    bool planned_motion = false; // --planned-motion: see sheep::plan()
+    std::string render = "surface"; // --render surface|renderer|null
+    // --crowd <population> <density>: see ground::setCrowd, off when 0
+    size_t crowd_population = 0;
+    size_t crowd_density = 0;
+    // --world <width> <height>: size of the field, the window by default
+    int world_width = frame_width;
+    int world_height = frame_height;
+    double zoom = 1.; // --zoom <factor>: 1 or less, see ground::setZoom
+};
+
+// Reads the options from argv[first] onwards
+appOptions parseOptions(int argc, char* argv[], int first);
+
+// Pixels of a row of a sprite that are all opaque or all partly transparent.
+// The fully transparent pixels between the runs are not stored.
+struct spriteRun {
+    int x;
+    int length;
+    bool opaque;
+};
+
+// A sprite converted to ARGB8888 with its colors premultiplied by alpha, for
+// the blitter of the surface backend
+struct premultipliedImage {
+    int w = 0;
+    int h = 0;
+    std::vector<Uint32> pixels;   // w * h, row after row
+    std::vector<spriteRun> runs;  // row after row, from left to right
+    std::vector<int> row_runs;    // h + 1, first run of each row
+};
+
+// The blitter of the surface backend. blendRow() blends count premultiplied
+// pixels of src over dst, by SIMD blocks when the target has them.
+void blendRow(Uint32* dst, const Uint32* src, int count);
+// Fills the runs of an image from its pixels
+void encodeRuns(premultipliedImage& image);
+// Draws the columns [src.x, src.x + src.w) of a row of the sprite at out
+void drawRuns(Uint32* out, const premultipliedImage& sprite, int row,
+    const SDL_Rect& src);
+
+// Every image is loaded once and shared by all the objects drawing it. The
+// bank owns the surfaces, objects keep the sprite id and a non-owning ptr.
+// The storage never reallocates, so a surface can be read from the render
+// thread while the simulation thread looks up ids.
+class spriteBank {
+public:
+    static constexpr size_t max_sprites = 512;
+    // Every image is stored with its copies of half, quarter... the size,
+    // and a single pixel for when it would be drawn smaller than dot_size
+    static constexpr int mip_levels = 5;
+    static constexpr int dot_size = 3;
+
+private:
+    std::vector<SDL_Surface*> sprites_;
+    std::vector<premultipliedImage> premultiplied_; // same ids as sprites_
+    // Same ids as sprites_: ids of the levels of an image, the pixel last
+    std::vector<std::array<int, mip_levels + 1>> mips_;
+    std::map<std::string, int> ids_;
+    std::mutex mutex_;
+
+    spriteBank();
+    int store(const std::string& name, SDL_Surface* sprite); // mutex_ held
+    int keep(SDL_Surface* sprite, premultipliedImage image); // mutex_ held
+
+public:
+    ~spriteBank();
 
+    static spriteBank& get();
+    int load(const std::string& file_path); // id of the image, loaded once
+    // id of an image made by the game, the bank takes it unless name is
+    // already there
+    int add(const std::string& name, SDL_Surface* sprite);
+    // id of a copy of image id with every channel multiplied by the one of
+    // rgb (0xRRGGBB), added under name
+    int tint(int id, const std::string& name, Uint32 rgb);
+    SDL_Surface* surface(int id) const;
+    const premultipliedImage& premultiplied(int id) const;
+    // id of the level of the image drawn at zoom, the nearest power of two
+    int scaled(int id, double zoom) const;
+};
+
+// Drawn by the ground through its render list, never on its own
 class renderedObject {
 protected:
-    SDL_Surface* window_surface_ptr_; // ptr to the surface on which we want the
-                                      // renderedObject to be drawn, non-owning
     SDL_Surface*
-        image_ptr_; // The texture of the renderedObject (the loaded image)
+        image_ptr_; // The texture of the renderedObject, owned by spriteBank
+    int sprite_;    // id of image_ptr_ in the spriteBank
     int pos_x_;
     int pos_y_;
 
 public:
-    renderedObject(const std::string& file_path, SDL_Surface* window_surface_ptr,
-        int pos_x, int pos_y);
+    renderedObject(const std::string& file_path, int pos_x, int pos_y);
     ~renderedObject();
 
-    virtual void draw() = 0;
     int get_pos_x() const;
     int get_pos_y() const;
+    int get_sprite() const;
+    void set_pos(int pos_x, int pos_y);
     void set_image_ptr(const std::string& file_path);
 };
 
@@ -48,74 +153,303 @@ class movingObject : public renderedObject {
 protected:
     int vit_x_;
     int vit_y_;
+    // The field the animals move in, the window by default
+    static int world_width_;
+    static int world_height_;
 
 public:
-    movingObject(const std::string& file_path, SDL_Surface* window_surface_ptr,
-        int pos_x, int pos_y, int vit_x, int vit_y);
+    movingObject(const std::string& file_path, int pos_x, int pos_y,
+        int vit_x, int vit_y);
     ~movingObject();
 
     virtual void move() = 0;
     void verifPosition();
+    static void setWorld(int width, int height);
+    static int worldWidth();
+    static int worldHeight();
     int getVit_x() const;
     int getVit_y() const;
     void setVit_x(int vit_x);
     void setVit_y(int vit_y);
 };
 
+// Bump allocator for the data that only lives during one tick. Allocating is
+// moving a pointer and reset() drops everything at once. What does not fit
+// the block falls back to the heap, and the block grows to the size needed
+// at the next reset, so a steady tick never reaches the heap.
+class frameArena {
+private:
+    std::unique_ptr<char[]> block_;
+    size_t capacity_;
+    size_t used_;
+    size_t needed_; // bytes asked since the last reset, fallbacks included
+    size_t peak_;
+    std::vector<std::unique_ptr<char[]>> overflow_;
+    unsigned fallbacks_; // allocations the block could not hold
+
+public:
+    explicit frameArena(size_t capacity = 64 * 1024);
+
+    void* allocate(size_t bytes, size_t alignment);
+    void reset();
+    size_t capacity() const;
+    size_t peak() const;
+    unsigned fallbacks() const;
+};
+
+// Lets the standard containers allocate from a frameArena. Freeing is a no-op,
+// the memory comes back with the reset of the arena.
+template <typename T> class arenaAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    frameArena* arena_;
+
+    explicit arenaAllocator(frameArena& arena) : arena_{ &arena } {}
+    template <typename U>
+    arenaAllocator(const arenaAllocator<U>& other) : arena_{ other.arena_ } {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T*, size_t) {}
+
+    template <typename U> bool operator==(const arenaAllocator<U>& other) const {
+        return arena_ == other.arena_;
+    }
+    template <typename U> bool operator!=(const arenaAllocator<U>& other) const {
+        return arena_ != other.arena_;
+    }
+};
+
+enum class species { sheep = 0, wolf, zombie, dog, sheperd, count };
+enum class sex { male = 0, female, count };
+enum class sheepColor { white = 0, red, blue, yellow, pink, orange, purple, green,
+    none, count };
+
+// From properties_[0], properties_[1] and properties_[4]
+species speciesOf(const std::string& type);
+sex sexOf(const std::string& sexe);
+sheepColor colorOf(const std::string& couleur);
+const char* colorName(sheepColor color);
+
+// The sprite of a sheep of every sex and color, made once by tinting the
+// wool of sheep.png and sheep_f.png. A new color only needs its tint.
+class sheepSprites {
+private:
+    std::array<int, (size_t)sex::count * (size_t)sheepColor::count> ids_;
+
+    sheepSprites();
+
+public:
+    static const sheepSprites& get();
+    int sprite(sex gender, sheepColor color) const;
+};
+
+// What the other animals see of an animal during a tick: saved before the
+// decisions and never written while they run
+struct entityState {
+    int index = -1; // position in the zoo during this tick
+    // Position at tick since. An animal on a planned path goes on by step at
+    // every tick (see sheep::plan()), step is 0 for the others.
+    int pos_x = 0;
+    int pos_y = 0;
+    unsigned long long since = 0;
+    int step_x = 0;
+    int step_y = 0;
+    species kind = species::count; // properties[0] and [1], read once
+    sex gender = sex::count;
+    std::vector<std::string> properties;
+
+    // Position at tick, the now() of the timer wheel of the ground
+    int x(unsigned long long tick) const {
+        return pos_x + (int)((long long)(tick - since) * step_x);
+    }
+    int y(unsigned long long tick) const {
+        return pos_y + (int)((long long)(tick - since) * step_y);
+    }
+};
+
+// Effect of an animal on another one. The decisions only write the animal
+// deciding, what they do to the others is applied once they are all over.
+struct intent {
+    enum kind { kill = 0, mate, hit };
+    int type;   // kind
+    int source; // indices in the zoo
+    int target;
+};
+
+using intentList = std::vector<intent, arenaAllocator<intent>>;
+
+// Hierarchical timer wheel counted in ticks. Level 0 has one slot per tick,
+// each level above covers 64 slots of the one below and is moved down a slot
+// at a time when the ticks reach it. Scheduling, cancelling and firing are
+// O(1) and a timer waiting for its deadline costs nothing per tick.
+// Only used from the serial phases of a tick (merge and integration).
+class timerWheel {
+public:
+    // Lives in the object it belongs to: scheduling never allocates and
+    // destroying the object cancels its timer
+    class timer {
+    public:
+        explicit timer(std::function<void()> expire);
+        ~timer();
+        timer(const timer&) = delete;
+        timer& operator=(const timer&) = delete;
+
+        bool active() const;
+
+    private:
+        friend class timerWheel;
+        std::function<void()> expire_;
+        timerWheel* wheel_; // set while scheduled
+        timer** slot_;      // head of the list holding the timer
+        timer* prev_;
+        timer* next_;
+        unsigned long long deadline_;
+    };
+
+    static constexpr int levels = 4;
+    static constexpr int slot_bits = 6;
+    static constexpr int slots = 1 << slot_bits;
+
+private:
+    timer* slots_[levels][slots];
+    unsigned long long now_;
+    size_t pending_;
+
+    void insert(timer& a_timer);
+    void unlink(timer& a_timer);
+
+public:
+    timerWheel();
+    ~timerWheel();
+    timerWheel(const timerWheel&) = delete;
+    timerWheel& operator=(const timerWheel&) = delete;
+
+    // Fires after delay calls to advance(), at least one
+    void schedule(timer& a_timer, unsigned delay);
+    void cancel(timer& a_timer);
+    void advance(); // next tick, fires the timers due
+    unsigned remaining(const timer& a_timer) const; // 0 when not scheduled
+    size_t pending() const;
+    unsigned long long now() const; // calls to advance() so far
+};
+
 class interactiveObject : public movingObject {
 protected:
     std::vector<std::string> properties_; // type, sexe, reproduction_timer, alive
+    entityState previous_;
+    timerWheel* timers_; // non-owning, set by the ground
+    int herd_;           // in the herdIndex of the ground, -1 for none
+    bool alive_;         // properties_[3] == "alive", read by every phase
+    bool idle_;          // see idle()
+
+    void saveProperties();
 
 public:
-    interactiveObject(const std::string& file_path,
-        SDL_Surface* window_surface_ptr, int pos_x, int pos_y,
+    interactiveObject(const std::string& file_path, int pos_x, int pos_y,
         int vit_x, int vit_y);
     ~interactiveObject();
 
-    virtual bool interact(std::shared_ptr<interactiveObject> interObject) = 0;
+    // Reacts to other as the rule of their pair says (see pair_rules), the
+    // effects on other are added to intents
+    bool interact(const entityState& other, intentList& intents);
     std::vector<std::string>& getProperties();
+    bool isAlive() const;
+    void kill(); // properties_[3] becomes "dead"
+    void saveState(int index);
+    const entityState& getPrevious() const;
+    // On a planned path: move() has nothing to do until the next event of
+    // the path and the saved state follows it, so the ground neither moves
+    // nor saves the animal at each tick
+    bool idle() const;
+    void reindex(int index);         // new position in the zoo
+    unsigned long long tick() const; // now() of the timer wheel, 0 without
+
+    // Brings pos_x_ and pos_y_ up to date before they are read
+    virtual void syncPosition();
+    void setTimerWheel(timerWheel* timers);
+    int getHerd() const;
+    void setHerd(int herd);
 };
 
 class sheperd : public interactiveObject {
 
 public:
-    sheperd(SDL_Surface* window_surface_ptr);
+    sheperd();
     ~sheperd();
 
-    void draw() override;
     void move() override;
-    bool interact(std::shared_ptr<interactiveObject> interObject) override;
 };
 
 class animal : public interactiveObject {
+protected:
+    // An escape started calm runs at full speed until the boost ends, then
+    // the animal only escapes at normal speed until it is calm again
+    enum escapeState { calm = 0, boosted, recovering };
+    static constexpr unsigned boost_ticks = 500;
+    static constexpr unsigned recovery_ticks = 500;
+    escapeState escapeState_;
+    bool boostEnded_; // the boost ended at this tick
+    timerWheel::timer escapeTimer_;
+
+    // Called first in move(): starts the timer of a boost begun this tick
+    void updateEscape();
+    void escapeTimerExpired();
 
 public:
-    animal(const std::string& file_path, SDL_Surface* window_surface_ptr,
-        int pos_x, int pos_y, int vit_x, int vit_y);
-    animal(const std::string& file_path, SDL_Surface* window_surface_ptr);
+    animal(const std::string& file_path, int pos_x, int pos_y, int vit_x,
+        int vit_y);
+    animal(const std::string& file_path);
     ~animal();
-
-    void draw() override;
 };
 
 // class sheep, derived from animal
 class sheep : public animal {
 
 private:
-    int reproductionTimer_;
-    int escapeTimer_;
+    static constexpr unsigned reproduction_ticks = 1000;
+    timerWheel::timer reproductionTimer_; // properties_[2] is "0" once over
     bool escape_;
 
+    // Planned motion: a wandering sheep goes in a straight line until the
+    // next wall, random turn or new speed. That event is its only cost until
+    // then, the position is worked out when it is read.
+    static bool planned_motion_;
+    bool planned_;
+    unsigned long long plan_tick_; // move the path starts after
+    int plan_x_;
+    int plan_y_;
+    int step_x_; // per move
+    int step_y_;
+    unsigned long long next_turn_;
+    unsigned long long next_speed_;
+    timerWheel::timer motionTimer_;
+
+    bool wandering() const;
+    void turn();
+    void newSpeed();
+    void settle(unsigned long long tick);
+    void plan();
+    void unplan();
+    void motionEvent();
+    void reproductionOver();
+
 public:
-    sheep(SDL_Surface* window_surface_ptr, int pos_x, int pos_y, int vit_x,
-        int vit_y, std::string couleur);
-    sheep(SDL_Surface* window_surface_ptr);
+    sheep(int pos_x, int pos_y, int vit_x, int vit_y, const std::string& couleur);
+    sheep();
     ~sheep();
 
     void move() override;
+    void syncPosition() override;
+    static void setPlannedMotion(bool planned_motion);
     const int getReproductionTimer();
-    void setReproductionTimer(int newTime);
-    bool interact(std::shared_ptr<interactiveObject> interObject) override;
+    void startReproductionTimer();
+    bool fertile() const; // properties_[2] is "0"
     bool reproduit(int pos_sheep_x, int pos_sheep_y);
     bool escape(int pos_wolf_x, int pos_wolf_y);
 };
@@ -125,14 +459,12 @@ class wolf : public animal {
 
     bool chasse_;
     bool escape_;
-    int escapeTimer_;
 
 public:
-    wolf(SDL_Surface* window_surface_ptr);
+    wolf();
     ~wolf();
 
     void move() override;
-    bool interact(std::shared_ptr<interactiveObject> interObject) override;
     bool croque(int pos_sheep_x, int pos_sheep_y);
     bool escape(int pos_dog_x, int pos_dog_y);
 };
@@ -140,17 +472,14 @@ public:
 // class zombie, derived from animal
 class zombie : public animal {
     bool escape_;
-    int escapeTimer_;
     bool chasse_;
 
 public:
-    zombie(SDL_Surface* window_surface_ptr);
-    zombie(SDL_Surface* window_surface_ptr, int pos_x, int pos_y, int vit_x,
-        int vit_y);
+    zombie();
+    zombie(int pos_x, int pos_y, int vit_x, int vit_y);
     ~zombie();
 
     void move() override;
-    bool interact(std::shared_ptr<interactiveObject> interObject) override;
     bool croque(int pos_sheep_x, int pos_sheep_y);
     bool recule(int pos_sheperd_x, int pos_sheperd_y);
 };
@@ -160,37 +489,719 @@ private:
     std::shared_ptr<sheperd> maitre_;
     bool proche_;
     bool escape_;
-    int escapeTimer_;
 
 public:
-    dog(SDL_Surface* window_surface_ptr, std::shared_ptr<sheperd> maitre);
+    dog(std::shared_ptr<sheperd> maitre);
     ~dog();
 
     void move() override;
-    bool interact(std::shared_ptr<interactiveObject> interObject) override;
     bool escape(int pos_dog_x, int pos_dog_y);
+    bool follow(int pos_sheperd_x, int pos_sheperd_y);
+};
+
+// What an animal does to the nearest animal one of its rules picked
+enum class reaction { none = 0, flee, eat, mate, follow };
+
+// One row of the interaction table: what actor does to the nearest other
+// closer than radius, -1 meaning anywhere. The rules of an actor are tried
+// by rank, the ones of the same rank keep a single nearest between them.
+// sex::count accepts both sexes.
+struct pairRule {
+    species actor;
+    species other;
+    reaction what;
+    int radius;
+    int rank;
+    sex actor_sex;
+    sex other_sex;
+};
+
+// Adding a species to the interactions is adding its rows. No code is
+// generated for the pairs left out, they ignore each other.
+constexpr pairRule pair_rules[] = {
+    { species::sheep,  species::zombie,  reaction::flee,   200, 0, sex::count, sex::count },
+    { species::sheep,  species::wolf,    reaction::flee,   200, 1, sex::count, sex::count },
+    { species::sheep,  species::sheep,   reaction::mate,    -1, 2, sex::male,  sex::female },
+    { species::wolf,   species::zombie,  reaction::flee,   200, 0, sex::count, sex::count },
+    { species::wolf,   species::dog,     reaction::flee,   300, 1, sex::count, sex::count },
+    { species::wolf,   species::sheep,   reaction::eat,     -1, 2, sex::count, sex::count },
+    { species::dog,    species::zombie,  reaction::flee,   200, 0, sex::count, sex::count },
+    { species::dog,    species::sheperd, reaction::follow, 200, 1, sex::count, sex::count },
+    { species::zombie, species::sheep,   reaction::eat,    200, 0, sex::count, sex::count },
+    { species::zombie, species::wolf,    reaction::eat,    200, 0, sex::count, sex::count },
+    { species::zombie, species::dog,     reaction::eat,    200, 0, sex::count, sex::count },
+    { species::zombie, species::sheperd, reaction::eat,    200, 0, sex::count, sex::count },
+};
+constexpr size_t species_count = (size_t)species::count;
+constexpr int rule_ranks = 3;
+
+// Rule of a pair, reaction::none when there is none
+constexpr pairRule pairRuleOf(species actor, species other) {
+    for (const pairRule& rule : pair_rules) {
+        if (rule.actor == actor && rule.other == other)
+            return rule;
+    }
+    return { actor, other, reaction::none, 0, 0, sex::count, sex::count };
+}
+
+// A single rule per pair, with a rank that has a slot
+constexpr bool pairRulesValid() {
+    for (size_t i = 0; i < std::size(pair_rules); i++) {
+        if (pair_rules[i].rank < 0 || pair_rules[i].rank >= rule_ranks ||
+            pair_rules[i].what == reaction::none)
+            return false;
+        for (size_t j = 0; j < i; j++) {
+            if (pair_rules[i].actor == pair_rules[j].actor &&
+                pair_rules[i].other == pair_rules[j].other)
+                return false;
+        }
+    }
+    return true;
+}
+static_assert(pairRulesValid(), "pair_rules: one rule per pair, rank below rule_ranks");
+
+// Farthest bounded radius of the table: the pair pass never looks further
+constexpr int pairRadius() {
+    int radius = 0;
+    for (const pairRule& rule : pair_rules) {
+        radius = rule.radius > radius ? rule.radius : radius;
+    }
+    return radius;
+}
+
+// Nearest candidate of one rank of an animal, found by the pair pass
+struct nearSlot {
+    long long dist; // squared
+    int index;      // in the zoo, -1 for none
+};
+
+// Keeps the number of animals of every species under a hard cap. Past the
+// soft cap a birth only happens with a probability falling linearly to 0 at
+// the hard cap, so the population levels off before it reaches the wall.
+// The counts per species, sex and color follow the animals entering and
+// leaving the zoo, so reading them never scans it.
+class populationManager {
+public:
+    struct caps {
+        size_t soft;
+        size_t hard;
+    };
+
+private:
+    static constexpr size_t kinds = (size_t)species::count;
+    static constexpr size_t sexes = (size_t)sex::count;
+    static constexpr size_t colors = (size_t)sheepColor::count;
+    caps caps_[kinds];
+    size_t alive_[kinds];
+    size_t by_sex_[kinds][sexes];
+    size_t by_color_[colors]; // sheep only
+    size_t peak_[kinds];
+    unsigned long long births_[kinds];
+    unsigned long long throttled_[kinds]; // refused between the caps
+    unsigned long long refused_[kinds];   // refused at the hard cap
+
+public:
+    populationManager(); // no cap until setCaps
+
+    void setCaps(species kind, caps limits);
+    size_t hardCap(species kind) const;
+    bool allowBirth(species kind); // counts the refused births
+    void added(const std::vector<std::string>& properties);
+    void removed(const std::vector<std::string>& properties);
+    size_t count(species kind) const;
+    size_t count(species kind, sex a_sex) const;
+    size_t count(sheepColor color) const;
+    void report() const;
+};
+
+// The animals eaten before halloween come back as zombies from the corners.
+// They wait in a queue and a tick releases at most spawn_per_tick of them,
+// or less once spawn_budget_ms is spent. The zombies are built in advance
+// in a pool, so releasing one only places it.
+class spawnScheduler {
+private:
+    struct spawn {
+        int x;
+        int y;
+    };
+    std::vector<spawn> queue_; // ring, only grows when full
+    size_t head_;
+    size_t size_;
+    std::vector<std::shared_ptr<zombie>> pool_;
+    size_t max_depth_;
+    unsigned long long spawned_;
+    unsigned built_late_; // zombies the pool did not have
+    unsigned busy_ticks_; // ticks that released zombies
+
+public:
+    spawnScheduler();
+
+    void prebuild(size_t count); // fills the pool, outside of the ticks
+    void request(int x, int y);
+    // A zombie at (x, y), from the pool when it has one
+    std::shared_ptr<zombie> take(int x, int y);
+    // Gives the spawns of this tick to add(x, y), which takes the zombie
+    template <typename F> void release(F add) {
+        if (size_ == 0) {
+            return;
+        }
+        Uint64 start = SDL_GetPerformanceCounter();
+        Uint64 budget = (Uint64)(spawn_budget_ms * SDL_GetPerformanceFrequency() / 1000.);
+        unsigned released = 0;
+        while (size_ > 0 && released < spawn_per_tick &&
+            SDL_GetPerformanceCounter() - start < budget) {
+            const spawn& next = queue_[head_];
+            add(next.x, next.y);
+            head_ = (head_ + 1) % queue_.size();
+            size_--;
+            released++;
+        }
+        spawned_ += released;
+        busy_ticks_++;
+    }
+    void report() const;
+};
+
+// One sprite to draw, in window coordinates. The render lists are sorted by
+// sprite, so that the pixels of a sprite stay in cache while it is drawn.
+struct spriteDraw {
+    int sprite; // id in the spriteBank
+    int x;
+    int y;
+};
+
+// What the render thread needs to draw one frame, published by the
+// simulation thread. Never modified once published.
+struct renderSnapshot {
+    int background = -1;
+    std::vector<spriteDraw> draws;
+    unsigned input_seq = 0; // last input applied before this snapshot
+    int status = 0;         // application::gameStatus
+};
+
+// Where the frames go. A frame is a background covering the window, then
+// batches of sprite draws in order, then the present. Chosen with --render,
+// the simulation only hands its render lists over.
+class renderBackend {
+protected:
+    unsigned long long frames_;
+    unsigned long long sprites_;
+
+public:
+    renderBackend();
+    virtual ~renderBackend();
+
+    virtual const char* name() const = 0;
+    virtual void clear(int background) = 0; // sprite ids of the spriteBank
+    virtual void draw(const spriteDraw* draws, size_t count) = 0;
+    virtual void present() = 0;
+    virtual void report() const;
+    // The window lost its pixels (covered, minimized, resized): the next
+    // present shows the whole frame
+    virtual void invalidate();
+
+    // Tiled composition, for the backends that can draw separate parts of a
+    // frame from several threads at once: beginTiles() with the background and
+    // the first list of the frame, then drawTile() for every tile in any order
+    // and on any thread, then endTiles(). More draw() may follow.
+    virtual bool tiles() const;
+    virtual void beginTiles(int background, const spriteDraw* draws, size_t count);
+    // The entries order[0..count) of the list overlap the tile
+    virtual void drawTile(const SDL_Rect& tile, const int* order, size_t count);
+    virtual void endTiles();
+};
+
+// Cells of the window whose pixels change from a frame to the next. They are
+// found by matching the draws of the two frames in order: a draw without
+// its match marks the cells it covers, at its old or its new place.
+class dirtyRegion {
+public:
+    static constexpr int cell_size = 32;
+    enum state : char { clean, dirty, drawn }; // drawn: dirty, already redrawn
+
+private:
+    int width_;
+    int height_;
+    int columns_;
+    int rows_;
+    std::vector<char> cells_;
+
+    void mark(const spriteDraw& draw);
+
+public:
+    dirtyRegion(int width, int height);
+
+    void reset(state a_state);
+    // Marks what differs between two lists sorted by sprite
+    void diff(const spriteDraw* before, size_t before_count,
+        const spriteDraw* after, size_t after_count);
+    void promote(state from, state to);
+    size_t count(state a_state) const;
+    size_t size() const;
+
+    // Calls f(rect) for every run of cells in a_state on a row, within clip
+    template <typename F> void forEachRun(state a_state, const SDL_Rect& clip, F f) const {
+        int x1 = std::min(clip.x + clip.w, width_);
+        int y1 = std::min(clip.y + clip.h, height_);
+        int c0 = std::max(clip.x, 0) / cell_size;
+        int c1 = (x1 - 1) / cell_size;
+        for (int r = std::max(clip.y, 0) / cell_size; r * cell_size < y1; r++) {
+            int y = std::max(r * cell_size, clip.y);
+            int h = std::min((r + 1) * cell_size, y1) - y;
+            int c = c0;
+            while (c <= c1) {
+                if (cells_[r * columns_ + c] != a_state) {
+                    c++;
+                    continue;
+                }
+                int first = c;
+                while (c <= c1 && cells_[r * columns_ + c] == a_state) {
+                    c++;
+                }
+                int x = std::max(first * cell_size, clip.x);
+                SDL_Rect run = { x, y, std::min(c * cell_size, x1) - x, h };
+                f(run);
+            }
+        }
+    }
+};
+
+// Blits on the window surface, presented by SDL_UpdateWindowSurface. When
+// the window is 32 bits RGB, the premultiplied sprites are blended by our
+// own SIMD blitter, else SDL blits them.
+// A frame is only kept by clear() and draw(), and composed by present() in
+// the cells that differ from the previous frame. They are the only ones
+// updated on the window, unless they are more than full_redraw of it.
+class surfaceBackend : public renderBackend {
+private:
+    static constexpr double full_redraw = 0.5;
+
+    SDL_Window* window_;   // non-owning
+    SDL_Surface* surface_; // owned by the window
+    bool blend_;           // the surface takes ARGB8888 pixels
+
+    int background_;
+    std::vector<spriteDraw> frame_;
+    std::vector<size_t> segments_;      // end in frame_ of each draw()
+    int previous_background_;
+    std::vector<spriteDraw> previous_;
+    std::vector<size_t> previous_segments_;
+    size_t tiled_segments_;             // segments composed by the tiles
+    dirtyRegion region_;
+    std::vector<SDL_Rect> rects_;
+    unsigned long long full_frames_;
+    unsigned long long partial_frames_;
+    unsigned long long dirty_cells_;
+
+    void lock();
+    void unlock();
+    void drawClipped(int sprite, int x, int y, const SDL_Rect& clip);
+    // The background and the frame from the draw first, within clip
+    void compose(const SDL_Rect& clip, size_t first);
+    void diffSegments(size_t first, size_t last);
+
+public:
+    explicit surfaceBackend(SDL_Window* window);
+
+    const char* name() const override;
+    void clear(int background) override;
+    void draw(const spriteDraw* draws, size_t count) override;
+    void present() override;
+    void report() const override;
+    void invalidate() override;
+    // Only with our blitter, SDL blits are not thread safe
+    bool tiles() const override;
+    void beginTiles(int background, const spriteDraw* draws, size_t count) override;
+    void drawTile(const SDL_Rect& tile, const int* order, size_t count) override;
+    void endTiles() override;
+};
+
+// SDL_RenderCopy of a texture per sprite with a software SDL_Renderer. The
+// draws may come from the threads of the task graph, so they are kept and
+// only submitted by present(), on the thread owning the renderer.
+class rendererBackend : public renderBackend {
+private:
+    SDL_Renderer* renderer_;
+    std::vector<SDL_Texture*> textures_; // by sprite id, made on first use
+    int background_;
+    std::vector<spriteDraw> pending_;
+
+    SDL_Texture* texture(int sprite);
+    void copy(int sprite, int x, int y);
+
+public:
+    explicit rendererBackend(SDL_Window* window);
+    ~rendererBackend();
+    rendererBackend(const rendererBackend&) = delete;
+    rendererBackend& operator=(const rendererBackend&) = delete;
+
+    const char* name() const override;
+    void clear(int background) override;
+    void draw(const spriteDraw* draws, size_t count) override;
+    void present() override;
+};
+
+// Draws nothing, to time the rest of the frame
+class nullBackend : public renderBackend {
+public:
+    const char* name() const override;
+    void clear(int background) override;
+    void draw(const spriteDraw* draws, size_t count) override;
+    void present() override;
+};
+
+// The backend named by --render
+std::unique_ptr<renderBackend> makeRenderBackend(const std::string& name,
+    SDL_Window* window);
+
+// One frame expressed as tasks and the dependencies between them. A task
+// must be added after the tasks it depends on, so the order of the ids is a
+// topological order. The duration of every task is recorded at each run.
+class taskGraph {
+public:
+    struct task {
+        std::string name;
+        std::function<void()> work;
+        std::vector<int> after;      // tasks this one waits for
+        std::vector<int> dependents; // tasks waiting for this one
+        Uint64 start = 0;            // last run, performance counter
+        Uint64 end = 0;
+        double total_ms = 0.;        // sum over all the runs
+    };
+
+private:
+    std::vector<task> tasks_;
+    unsigned runs_;
+    double total_span_ms_; // first start to last end, summed over the runs
+
+public:
+    taskGraph();
+
+    int add(const std::string& name, std::function<void()> work,
+        std::vector<int> after = {});
+    // Splits work(chunk, chunks) in independent tasks, returns the id of a
+    // task that ends when all the chunks are done
+    int addParallel(const std::string& name, unsigned chunks,
+        std::function<void(unsigned, unsigned)> work, std::vector<int> after = {});
+    size_t size() const;
+    task& at(int id);
+    void finishRun(); // called by the executor once every task ran
+    void report() const;
+};
+
+// Runs a taskGraph on a pool of worker threads. A task is started as soon as
+// the tasks it waits for are done, so independent tasks run at the same time.
+// The thread calling wait() runs tasks as well.
+class taskExecutor {
+private:
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable changed_; // new ready tasks, graph done or quit
+    std::vector<int> ready_;
+    std::vector<int> pending_;        // dependencies left per task
+    taskGraph* graph_;                // graph running, nullptr when idle
+    size_t remaining_;
+    std::exception_ptr error_;
+    bool quit_;
+
+    void workerLoop();
+    bool runOne(std::unique_lock<std::mutex>& lock);
+
+public:
+    taskExecutor(unsigned workers);
+    ~taskExecutor();
+
+    unsigned size() const; // workers plus the calling thread
+    void start(taskGraph& graph); // returns at once
+    void wait();                  // helps until the graph is done
+    void run(taskGraph& graph);
+};
+
+// Uniform grid over the world, rebuilt once per tick, used to only pair the
+// animals near each other. Stores the indices of the animals in the zoo.
+// Only the cells holding animals are kept, sorted by row then column, so the
+// grid and its passes follow the number of animals, not the area of the
+// world.
+class spatialGrid {
+private:
+    int cell_size_;
+    int columns_;
+    int rows_;
+    std::vector<long long> keys_;    // occupied cells, row * columns_ + column
+    std::vector<int> starts_;        // first entry of each of keys_ in indices_
+    std::vector<int> indices_;       // the animals, cell after cell
+    std::vector<long long> cell_of_; // key of the cell of each animal
+
+    int column(int x) const;
+    int row(int y) const;
+    long long key(int r, int c) const { return (long long)r * columns_ + c; }
+    int lowerCell(long long key) const; // first occupied cell at or after key
+    int firstCell(size_t entry) const;  // first cell starting at or after entry
+
+public:
+    spatialGrid(int cell_size, int width, int height);
+
+    // Places the animals where their saved states are at tick
+    void build(const std::vector<std::shared_ptr<interactiveObject>>& objects,
+        unsigned long long tick);
+    void reserve(size_t objects);
+
+    // Calls f(i, j) once for every pair of animals in cells close enough to
+    // be within radius of each other. Each cell pairs its animals with the
+    // cells after it only. The chunk visits the pairs starting in its share
+    // of the cells, shared out by number of animals.
+    template <typename F>
+    void forEachPair(int radius, unsigned chunk, unsigned chunks, F f) const {
+        int reach = (radius + cell_size_ - 1) / cell_size_;
+        size_t total = indices_.size();
+        int first = firstCell(total * chunk / chunks);
+        int last = firstCell(total * (chunk + 1) / chunks);
+        for (int cell = first; cell < last; cell++) {
+            int r = (int)(keys_[cell] / columns_);
+            int c = (int)(keys_[cell] % columns_);
+            for (int a = starts_[cell]; a < starts_[cell + 1]; a++) {
+                for (int b = a + 1; b < starts_[cell + 1]; b++) {
+                    f(indices_[a], indices_[b]);
+                }
+            }
+            // The rest of its row, then the cells below it
+            for (int dr = 0; dr <= reach && r + dr < rows_; dr++) {
+                long long to = key(r + dr, std::min(columns_ - 1, c + reach));
+                int other = dr == 0 ? cell + 1 :
+                    lowerCell(key(r + dr, std::max(0, c - reach)));
+                for (; other < (int)keys_.size() && keys_[other] <= to; other++) {
+                    for (int a = starts_[cell]; a < starts_[cell + 1]; a++) {
+                        for (int b = starts_[other]; b < starts_[other + 1]; b++) {
+                            f(indices_[a], indices_[b]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+};
+
+// Groups the sheep in herds for the searches reaching the whole field. A
+// sheep keeps its herd from tick to tick while it stays within join_radius
+// of the centre, only the ones that strayed look for another herd or start
+// one. The centre and the bounding radius of every herd are updated from
+// its members at each tick.
+class herdIndex {
+public:
+    static constexpr int join_radius = 150;
+
+private:
+    struct herd {
+        long long sum_x;
+        long long sum_y;
+        int count;
+        int x; // centre
+        int y;
+        int radius; // of the circle holding all the members
+        bool used;
+    };
+    std::vector<herd> herds_;
+    std::vector<int> free_;    // unused entries of herds_
+    std::vector<int> herd_of_; // herd of every animal of the zoo, -1 if none
+    std::vector<int> starts_;  // members of each herd in members_
+    std::vector<int> members_;
+    std::vector<int> next_;
+    unsigned long long ticks_;
+    unsigned long long strays_; // sheep that changed herd
+    // The searches run from the chunks of the decisions
+    std::atomic<unsigned long long> searches_;
+    std::atomic<unsigned long long> searched_; // herds visited
+
+    int join(int x, int y) const; // nearest herd within join_radius, or -1
+
+public:
+    herdIndex();
+
+    void update(const std::vector<std::shared_ptr<interactiveObject>>& objects,
+        unsigned long long tick);
+    void reserve(size_t objects);
+    void report() const;
+
+    // Calls f(index) on the members of every herd that can hold a sheep
+    // closer to (x, y) than bound(), a squared distance. The nearest herd
+    // comes first so that bound() shrinks before the others are tried.
+    template <typename B, typename F>
+    void search(int x, int y, B bound, F f) {
+        this->searches_.fetch_add(1, std::memory_order_relaxed);
+        int first = -1;
+        long long first_bound = 0;
+        for (size_t h = 0; h < herds_.size(); h++) {
+            long long low = lowerBound(herds_[h], x, y);
+            if (herds_[h].used && (first < 0 || low < first_bound)) {
+                first = (int)h;
+                first_bound = low;
+            }
+        }
+        if (first < 0) {
+            return;
+        }
+        visit(first, f);
+        for (size_t h = 0; h < herds_.size(); h++) {
+            if (herds_[h].used && (int)h != first &&
+                lowerBound(herds_[h], x, y) <= bound()) {
+                visit((int)h, f);
+            }
+        }
+    }
+
+private:
+    // Squared distance from (x, y) to the circle of a herd, 0 inside
+    static long long lowerBound(const herd& a_herd, int x, int y);
+
+    template <typename F> void visit(int h, F f) {
+        this->searched_.fetch_add(1, std::memory_order_relaxed);
+        for (int i = starts_[h]; i < starts_[h + 1]; i++) {
+            f(members_[i]);
+        }
+    }
+};
+
+// Tiles of the window, each with the entries of a render list overlapping it
+// in the order of the list. Rebuilt every frame for the tiled composition.
+class tileBins {
+public:
+    static constexpr int tile_size = 128;
+
+private:
+    int columns_;
+    int rows_;
+    std::vector<int> starts_;  // first entry of each tile in indices_
+    std::vector<int> indices_; // in the render list
+    std::vector<int> next_;    // next free entry of each tile during build
+
+    // Tiles overlapped by a draw, false when it is out of the window
+    bool span(const spriteDraw& draw, int& c0, int& c1, int& r0, int& r1) const;
+
+public:
+    tileBins(int width, int height);
+
+    void build(const std::vector<spriteDraw>& draws);
+    void reserve(size_t draws);
+    int size() const;
+    SDL_Rect rect(int tile) const;
+    const int* entries(int tile) const;
+    size_t count(int tile) const;
 };
 
 // The "ground" on which all the animals live (like the std::vector
 // in the zoo example).
 class ground {
 private:
-    // Attention, NON-OWNING ptr, again to the screen
-    SDL_Surface* window_surface_ptr_;
-    SDL_Surface* image_ptr_;
+    renderBackend* backend_; // non-owning, where the frames are drawn
+    int background_;
+    int background_halloween_;
     std::string image_ground = "fond.png";
     std::string image_ground_halloween = "fondHalloween.png";
     // Some attribute to store all the wolves and sheep
     // here
     std::vector<std::shared_ptr<interactiveObject>> the_zoo;
-    std::vector<std::shared_ptr<interactiveObject>> old_zoo;
+    populationManager population_;
+    std::shared_ptr<interactiveObject> sheperd_; // nullptr once eaten
+    int sheperd_index_ = -1;                     // in the_zoo, -1 once eaten
+    // The animals integrate() moves, the idle ones are left out. Made by
+    // resolve(), which goes through the zoo anyway.
+    std::vector<int> movers_;
+    unsigned long long idle_sum_ = 0; // idle animals, summed over the ticks
 
     SDL_Rect* sdl_rect_;
-    int dead = 0;
+    spawnScheduler spawner_;
     bool halloween_;
+    bool late_sheperd_;
+
+    spatialGrid grid_;
+    bool grid_fresh_; // the grid already matches the_zoo for this tick
+    herdIndex herds_;
+    bool use_herds_;
+    std::vector<spriteDraw> draws_;
+    std::vector<spriteDraw> unsorted_; // the render list before its sort
+    tileBins tiles_;
+
+    // The window shows the part of the world at (camera_x_, camera_y_), the
+    // animals outside of it are left out of the render list. A pixel of the
+    // window is 1 / zoom_ pixels of the world.
+    int world_width_;
+    int world_height_;
+    int camera_x_;
+    int camera_y_;
+    double zoom_;
+    unsigned long long render_frames_;
+    unsigned long long culled_;
+
+    // One arena per chunk of the decisions, so the threads never share an
+    // allocator. The first one also serves the serial phases.
+    std::vector<frameArena> arenas_;
+    unsigned ticks_;
+    unsigned fallbacks_;      // heap fallbacks of the arenas so far
+    unsigned heap_ticks_;     // ticks where an arena fell back to the heap
+    unsigned last_heap_tick_;
+
+    timerWheel timers_;
+
+    // Intents of the decisions, one list per chunk of the zoo, and the ones
+    // of the input waiting for the next tick
+    std::vector<intentList> intents_;
+    std::vector<intent> input_intents_;
+    // Nearest slots of the pair pass, rule_ranks per animal and one array
+    // per chunk, in the arena of the chunk
+    std::vector<nearSlot*> near_;
+
+    // Tick as a task graph, when an executor is given
+    taskExecutor* executor_;
+    taskGraph graph_;
+    taskGraph prefetch_graph_;
+    bool draw_; // the graph also draws (update) or only simulates (step)
+
+    // Crowds drawn as one patch per tile of the window, tinted by how many
+    // animals it holds, with the sprite of one of them on top
+    static constexpr int crowd_tile = 64;
+    static constexpr int crowd_levels = 4;  // tints of the patches
+    static constexpr int crowd_focus = 200; // around the sheperd and the cursor
+    size_t crowd_population_;
+    size_t crowd_density_;
+    // Last position of the cursor in the window, given by moveCursor() so
+    // the render list never reads the input state of SDL
+    int cursor_x_;
+    int cursor_y_;
+    int crowd_columns_;
+    int crowd_rows_;
+    std::array<int, crowd_levels> crowd_patches_;
+    std::vector<int> crowd_tile_of_; // by animal, -1 when drawn on its own
+    std::vector<int> crowd_counts_;  // by tile, 0 when not a crowd
+    std::vector<int> crowd_sprite_;  // by tile, sprite of its first animal
+    unsigned long long crowd_frames_;
+    unsigned long long crowd_tiles_;
+    unsigned long long crowd_hidden_;
+
+    // Phases of a tick
+    void buildGrid();
+    void applyInputs();
+    void pairs(unsigned chunk, unsigned chunks);
+    void decide(unsigned chunk, unsigned chunks);
+    void merge();
+    void birth(const std::shared_ptr<interactiveObject>& parent,
+        const std::shared_ptr<interactiveObject>& partner);
+    void resolve();
+    // Alive, and not the sheperd when it moves late
+    bool inTick(size_t i) const;
+    void integrate();
+    void spawnDespawn();
+    void resetArenas();
+    void drawBackground();
+    void followSheperd();
+    bool project(int sprite, int pos_x, int pos_y, spriteDraw& draw) const;
+    void buildRenderList(std::vector<spriteDraw>& draws);
+    void blitRenderList();
+    void drawTiles(unsigned chunk, unsigned chunks);
+    bool markCrowds();
+    void addImpostors();
 
 public:
-    ground(SDL_Surface* window_surface_ptr); // todo: Ctor
+    ground(renderBackend* backend, int world_width, int world_height);
     ~ground(); // todo: Dtor, again for clean up (if necessary)
     
     bool get_Haloween();
@@ -198,21 +1209,190 @@ public:
     void add_animal(
         std::shared_ptr<interactiveObject> an_animal); // todo: Add an animal
     void update(); // todo: "refresh the screen": Move animals and draw them
+    void step();   // Move the animals without drawing them
+    void draw();   // Draw the background and every living animal
+    void fillSnapshot(renderSnapshot& snapshot);
     // Possibly other methods, depends on your implementation
-    void interract(std::shared_ptr<interactiveObject> an_animal);
+    void interract(const std::shared_ptr<interactiveObject>& an_animal,
+        intentList& intents);
     void moveSheperd(SDL_Event& window_event_); 
     void clickButton(SDL_Event& window_event_);
+    void zoomView(SDL_Event& window_event_);
+    void moveCursor(SDL_Event& window_event_);
+    // Between the whole world in the window and 1, sprites are never enlarged
+    void setZoom(double zoom);
+    // When true update() leaves the sheperd to updateSheperd()
+    void setLateSheperd(bool late_sheperd);
+    void updateSheperd();
+    // Runs the ticks on the executor, nullptr to go back to serial ticks
+    void useTaskGraph(taskExecutor* executor);
+    // Builds the grid of the next tick while the caller presents
+    void startPrefetch();
+    void finishPrefetch();
+    void report() const;
+    void prebuildZombies(size_t count);
+    // Caps the sheep and the zombies, the storage is reserved up to the caps
+    void setPopulationCaps(populationManager::caps sheep_caps,
+        populationManager::caps zombie_caps);
+    // Searches the sheep far away herd by herd instead of the whole field
+    void useHerds(bool use_herds);
+    // Above population animals alive, every tile of the window with two
+    // animals or more is drawn as a crowd, else only the tiles with density
+    // animals or more. Off when density is 0.
+    void setCrowd(size_t population, size_t density);
 
     int getScore();
     bool ground::isSheperdAlive();
 };
 
+// Counts the heap allocations of every phase of the main loop, to catch a new
+// allocation in the steady frames before it shows in the frame times. The
+// hooks of operator new only exist when built with ALLOC_GUARD, otherwise
+// the calls below do nothing. Each thread charges its allocations to its own
+// current phase, the threads of the pool to "other threads".
+class allocGuard {
+public:
+    enum phase { other = 0, input, rules, update, present, pacing, phase_count };
+    static constexpr unsigned warmup_frames = 30; // 2 s at 15 fps
+
+    static void enter(phase a_phase); // phase of the calling thread
+    static void setStrict(bool strict);
+    // Closes a frame: after warm-up, a frame that allocated is logged with
+    // the stack of its first allocation, or ends the run when strict
+    static void endFrame();
+    static void report();
+};
+
+// Paces the main loop on SDL_GetPerformanceCounter. Deadlines are absolute
+// (start + n * period), so a late frame is caught up by the next one instead
+// of pushing every following frame back. The wait sleeps coarsely with
+// SDL_Delay and spins the last part, the spin margin follows the oversleep
+// observed on this machine. When the loop presents after the wait (late
+// input), presented() times that tail and the wait ends that much before
+// the deadline, so the present stays inside the frame.
+class framePacer {
+private:
+    Uint64 frequency_;     // counter ticks per second
+    Uint64 period_;        // frame period in counter ticks
+    Uint64 spin_margin_;   // part of the wait done by spinning
+    Uint64 start_;
+    Uint64 frame_start_;
+    Uint64 next_deadline_;
+    Uint64 tail_;             // expected time from the wait to the present
+    Uint64 present_deadline_; // deadline of the present after the wait
+
+    // Statistics
+    unsigned frames_;
+    unsigned missed_;      // frames whose work ended after the deadline
+    Sint64 drift_;         // accumulated lateness of the wake ups
+    Uint64 max_work_;      // longest update + present
+    Uint64 max_late_;
+    double jitter_sum_;    // sum of |interval - period|
+    Uint64 max_jitter_;
+    unsigned late_presents_; // presents after the wait ending past the deadline
+    Uint64 max_tail_;
+
+public:
+    framePacer(double period);
+
+    void start();
+    void wait(); // end of the frame, returns at the start of the next one
+    void presented(); // after a present that followed wait()
+    double toMs(Uint64 ticks) const;
+    double elapsed() const; // seconds since start()
+    void report() const;
+};
+
+// Measures the time between an input event and the present that shows its
+// effect. Each key or mouse event is stamped when SDL queued it (ms) and when
+// the loop polled it (performance counter), the next present closes it.
+class latencyTracker {
+private:
+    struct pendingInput {
+        Uint32 queued; // SDL event timestamp
+        Uint64 polled; // performance counter
+        unsigned seq;
+    };
+    std::vector<pendingInput> pending_;
+    std::vector<double> from_event_; // ms, event queued -> present
+    std::vector<double> from_poll_;  // ms, event polled -> present
+    unsigned seq_;
+
+public:
+    latencyTracker();
+
+    unsigned input(const SDL_Event& event); // sequence number of the event
+    void presented();
+    void presented(unsigned last_seq); // only the events up to last_seq
+    void report() const;
+};
+
+// Lock free triple buffer: one writer fills back() and publish()es it, one
+// reader picks the latest published slot with update() and reads front().
+// Neither side ever waits, the writer overwrites a slot the reader skipped.
+template <typename T> class tripleBuffer {
+private:
+    static constexpr unsigned fresh_bit = 4;
+    T buffers_[3];
+    std::atomic<unsigned> middle_; // index of the middle slot | fresh_bit
+    unsigned back_;
+    unsigned front_;
+
+public:
+    tripleBuffer() : middle_{ 1 }, back_{ 0 }, front_{ 2 } {}
+
+    T& back() { return buffers_[back_]; }
+    const T& front() const { return buffers_[front_]; }
+
+    void publish() {
+        back_ = middle_.exchange(back_ | fresh_bit, std::memory_order_acq_rel) &
+            (fresh_bit - 1);
+    }
+
+    // True when a newer slot was published since the last call
+    bool update() {
+        if (!(middle_.load(std::memory_order_relaxed) & fresh_bit))
+            return false;
+        front_ = middle_.exchange(front_, std::memory_order_acq_rel) &
+            (fresh_bit - 1);
+        return true;
+    }
+};
+
+// Lock free single producer single consumer ring of Size - 1 elements
+template <typename T, size_t Size> class spscQueue {
+private:
+    T items_[Size];
+    std::atomic<size_t> head_{ 0 }; // next slot to read, owned by the consumer
+    std::atomic<size_t> tail_{ 0 }; // next slot to write, owned by the producer
+
+public:
+    bool push(const T& item) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t next = (tail + 1) % Size;
+        if (next == head_.load(std::memory_order_acquire))
+            return false;
+        items_[tail] = item;
+        tail_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+            return false;
+        item = items_[head];
+        head_.store((head + 1) % Size, std::memory_order_release);
+        return true;
+    }
+};
+
 // The application class, which is in charge of generating the window
 class application {
 private:
     // The following are OWNING ptrs
     SDL_Window* window_ptr_;
-    SDL_Surface* window_surface_ptr_;
+    std::unique_ptr<renderBackend> backend_;
     SDL_Event window_event_;
 
     // Other attributes here, for example an instance of ground
@@ -220,10 +1400,34 @@ private:
 
     unsigned n_wolf_;
     unsigned n_sheep_;
+    appOptions options_;
+    latencyTracker latency_;
+
+    // Pipeline mode: input from the main thread to the simulation thread
+    struct inputEvent {
+        SDL_Event event;
+        unsigned seq;
+    };
+    spscQueue<inputEvent, 256> inputs_;
+    tripleBuffer<renderSnapshot> snapshots_;
+    std::atomic<bool> stop_;
+    std::unique_ptr<taskExecutor> executor_;
+
+    enum gameStatus { running = 0, time_over, no_sheep, sheperd_dead };
+
+    bool pollEvents(); // false when the window is closed
+    void reportStats() const;
+    // To the simulation thread in pipeline mode, else applied at once
+    void forwardEvent(const SDL_Event& event, unsigned seq);
+    void applyEvent(SDL_Event& event);
+    gameStatus checkRules(unsigned period);
+    void simulate(unsigned period); // body of the simulation thread
+    int loopPipeline(unsigned period);
 
 public:
-    application(unsigned n_sheep, unsigned n_wolf); // Ctor
-    ~application();                                 // dtor
+    application(unsigned n_sheep, unsigned n_wolf,
+        const appOptions& options); // Ctor
+    ~application();                 // dtor
 
     int loop(unsigned period); // main loop of the application.
                                // this ensures that the screen is updated
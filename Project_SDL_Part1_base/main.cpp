@@ -6,16 +6,18 @@ int main(int argc, char* argv[]) {
 
   std::cout << "Starting up the application" << std::endl;
 
-  if (argc != 4)
+  if (argc < 4)
     throw std::runtime_error("Need three arguments - "
                              "number of sheep, number of wolves, "
                              "simulation time\n");
 
+  appOptions options = parseOptions(argc, argv, 4);
+
   init();
 
   std::cout << "Done with initilization" << std::endl;
 
-  application my_app(std::stoul(argv[1]), std::stoul(argv[2]));
+  application my_app(std::stoul(argv[1]), std::stoul(argv[2]), options);
   
   std::cout << "Created window" << std::endl;
   std::cout << "" << std::endl;
@@ -0,0 +1,140 @@
+// Checks that the animals go for the same target as a scan of the whole
+// field. Run from media/: the animals load their images.
+#include "../Project_SDL1.h"
+#include <cstdlib>
+#include <string>
+
+namespace {
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+// Speed of a wolf at (from_x, from_y) chasing a sheep at (to_x, to_y)
+std::pair<int, int> chaseSpeed(int from_x, int from_y, int to_x, int to_y) {
+    wolf reference;
+    reference.set_pos(from_x, from_y);
+    reference.croque(to_x, to_y);
+    return { reference.getVit_x(), reference.getVit_y() };
+}
+
+std::pair<int, int> speedOf(const std::shared_ptr<wolf>& a_wolf) {
+    return { a_wolf->getVit_x(), a_wolf->getVit_y() };
+}
+
+// The sheep straight ahead is in a cell the pair pass does not visit, the
+// one on the diagonal is further but in a visited cell
+void nearestOutOfPairRadius() {
+    movingObject::setWorld(2000, 2000);
+    auto backend = makeRenderBackend("null", nullptr);
+    ground field(backend.get(), 2000, 2000);
+    auto hunter = std::make_shared<wolf>();
+    hunter->set_pos(799, 799);
+    field.add_animal(hunter);
+    field.add_animal(std::make_shared<sheep>(1200, 799, 0, 0, "white")); // 401 px
+    field.add_animal(std::make_shared<sheep>(375, 375, 0, 0, "white"));  // 600 px
+    field.step();
+    check(speedOf(hunter) == chaseSpeed(799, 799, 1200, 799),
+        "the wolf chases the sheep 401 px away, not the one 600 px away");
+}
+
+// Every wolf chases the sheep a scan of the whole field finds, with and
+// without the herds. With the planned motion, the first ticks put the sheep
+// on their paths: the last one reads where the idle ones are on them.
+// Returns the number of idle sheep.
+int nearestOfTheField(bool herds, bool planned, unsigned seed) {
+    std::srand(seed);
+    sheep::setPlannedMotion(planned);
+    movingObject::setWorld(3000, 2000);
+    auto backend = makeRenderBackend("null", nullptr);
+    ground field(backend.get(), 3000, 2000);
+    field.useHerds(herds);
+    std::vector<std::shared_ptr<sheep>> flock;
+    std::vector<std::shared_ptr<wolf>> pack;
+    for (int i = 0; i < 30; i++) {
+        flock.push_back(std::make_shared<sheep>());
+        field.add_animal(flock.back());
+    }
+    for (int i = 0; i < 20; i++) {
+        pack.push_back(std::make_shared<wolf>());
+        field.add_animal(pack.back());
+    }
+    // Some ticks along the paths, so that they are not where they started
+    for (int i = 0; planned && i < 8; i++) {
+        field.step();
+    }
+    // Where the sheep are during the tick, read before it moves them
+    std::vector<std::pair<int, int>> positions;
+    int idle = 0;
+    for (auto it = flock.begin(); it != flock.end();) {
+        // A lamb would be missing from the scan
+        if ((*it)->getProperties()[1] == "male" && (*it)->getProperties()[2] != "0") {
+            sheep::setPlannedMotion(false);
+            return 0;
+        }
+        if (!(*it)->isAlive()) {
+            it = flock.erase(it);
+            continue;
+        }
+        idle += (*it)->idle() ? 1 : 0;
+        (*it)->syncPosition();
+        positions.push_back({ (*it)->get_pos_x(), (*it)->get_pos_y() });
+        ++it;
+    }
+    std::vector<int> indices;
+    for (const auto& prey : flock) {
+        indices.push_back(prey->getPrevious().index);
+    }
+    field.step();
+    sheep::setPlannedMotion(false);
+    for (const auto& hunter : pack) {
+        if (!hunter->isAlive()) {
+            continue;
+        }
+        const entityState& self = hunter->getPrevious();
+        int nearest = -1;
+        long long nearest_dist = 0;
+        for (size_t i = 0; i < flock.size(); i++) {
+            long long dx = positions[i].first - self.pos_x;
+            long long dy = positions[i].second - self.pos_y;
+            long long dist = dx * dx + dy * dy;
+            if (nearest < 0 || dist < nearest_dist ||
+                (dist == nearest_dist && indices[i] < indices[nearest])) {
+                nearest = (int)i;
+                nearest_dist = dist;
+            }
+        }
+        // Close enough to be eaten: the wolf jumps instead of running
+        if (nearest < 0 || nearest_dist < 50 * 50) {
+            continue;
+        }
+        check(speedOf(hunter) == chaseSpeed(self.pos_x, self.pos_y,
+            positions[nearest].first, positions[nearest].second),
+            std::string("wolf ") + std::to_string(self.index) +
+            " chases the nearest sheep, seed " + std::to_string(seed) +
+            (herds ? " (herds)" : "") + (planned ? " (planned motion)" : ""));
+    }
+    return idle;
+}
+} // namespace
+
+int main(int, char*[]) {
+    nearestOutOfPairRadius();
+    int idle = 0;
+    for (unsigned seed = 1; seed <= 20; seed++) {
+        nearestOfTheField(false, false, seed);
+        nearestOfTheField(true, false, seed);
+        idle += nearestOfTheField(false, true, seed);
+        idle += nearestOfTheField(true, true, seed);
+    }
+    check(idle > 0, "some sheep are idle on their paths");
+    if (failures > 0) {
+        return EXIT_FAILURE;
+    }
+    std::cout << "pairTests: all passed" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,288 @@
+// Checks that the blitter of the surface backend draws the pixels of a
+// plain blend, whatever the way the frame is drawn. Run from media/: the
+// sprites are loaded from there, in a hidden window (SDL_VIDEODRIVER=dummy
+// without a display).
+#include "../Project_SDL1.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+
+namespace {
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+// A premultiplied pixel: no channel above its alpha. Transparent and opaque
+// pixels come often, and in blocks, for the shortcuts of the blitter.
+Uint32 randomPixel(std::mt19937& random, bool block_opaque, bool block_clear) {
+    Uint32 alpha;
+    if (block_clear) {
+        alpha = 0;
+    }
+    else if (block_opaque) {
+        alpha = 255;
+    }
+    else {
+        int kind = random() % 4;
+        alpha = kind == 0 ? 0 : kind == 1 ? 255 : random() % 256;
+    }
+    Uint32 pixel = alpha << 24;
+    for (int shift = 0; shift < 24; shift += 8) {
+        pixel |= (Uint32)(random() % (alpha + 1)) << shift;
+    }
+    return pixel;
+}
+
+// src + dst * (255 - alpha) / 255 rounded, on every channel
+Uint32 blendPixel(Uint32 dst, Uint32 src) {
+    Uint32 alpha = src >> 24;
+    Uint32 blended = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        Uint32 d = (dst >> shift) & 0xff;
+        Uint32 channel = ((src >> shift) & 0xff) + (d * (255 - alpha) + 127) / 255;
+        blended |= std::min(channel, 255u) << shift;
+    }
+    return blended;
+}
+
+// Rows of every length around the SIMD blocks, at every alignment
+void blendRowMatchesScalar() {
+    std::mt19937 random(1);
+    for (int round = 0; round < 20000; round++) {
+        int count = 1 + random() % 40;
+        int offset = random() % 8;
+        bool opaque = random() % 4 == 0;
+        bool clear = !opaque && random() % 4 == 0;
+        std::vector<Uint32> src(offset + count);
+        std::vector<Uint32> dst(offset + count);
+        for (int i = 0; i < offset + count; i++) {
+            src[i] = randomPixel(random, opaque && i < offset + count / 2,
+                clear && i >= offset + count / 2);
+            dst[i] = random();
+        }
+        std::vector<Uint32> expected = dst;
+        for (int i = offset; i < offset + count; i++) {
+            expected[i] = blendPixel(dst[i], src[i]);
+        }
+        blendRow(dst.data() + offset, src.data() + offset, count);
+        if (dst != expected) {
+            check(false, "blendRow() of " + std::to_string(count) +
+                " pixels at offset " + std::to_string(offset) + ", round " +
+                std::to_string(round));
+            return;
+        }
+    }
+}
+
+// Sprites with their runs drawn row by row through a window, against the
+// whole clipped rows blended
+void runsMatchRows() {
+    std::mt19937 random(2);
+    const int width = 50;
+    const int height = 8;
+    for (int round = 0; round < 3000; round++) {
+        premultipliedImage sprite;
+        sprite.w = 1 + random() % 70;
+        sprite.h = 1 + random() % 10;
+        sprite.pixels.resize((size_t)sprite.w * sprite.h);
+        for (Uint32& pixel : sprite.pixels) {
+            pixel = randomPixel(random, random() % 3 == 0, random() % 3 == 0);
+        }
+        encodeRuns(sprite);
+        int x = (int)(random() % 100) - 40;
+        int y = (int)(random() % 16) - 6;
+        int x0 = std::max(x, 0);
+        int y0 = std::max(y, 0);
+        int x1 = std::min(x + sprite.w, width);
+        int y1 = std::min(y + sprite.h, height);
+        if (x0 >= x1 || y0 >= y1) {
+            continue;
+        }
+        SDL_Rect src = { x0 - x, y0 - y, x1 - x0, y1 - y0 };
+        std::vector<Uint32> runs(width * height);
+        for (Uint32& pixel : runs) {
+            pixel = random();
+        }
+        std::vector<Uint32> rows = runs;
+        for (int row = 0; row < src.h; row++) {
+            drawRuns(&runs[(y0 + row) * width + x0], sprite, src.y + row, src);
+            blendRow(&rows[(y0 + row) * width + x0],
+                &sprite.pixels[(size_t)(src.y + row) * sprite.w + src.x], src.w);
+        }
+        if (runs != rows) {
+            check(false, "drawRuns() of a " + std::to_string(sprite.w) + " x " +
+                std::to_string(sprite.h) + " sprite at (" + std::to_string(x) +
+                ", " + std::to_string(y) + "), round " + std::to_string(round));
+            return;
+        }
+    }
+}
+
+// Same pixels on both window surfaces
+bool sameSurface(SDL_Window* window, SDL_Window* other) {
+    SDL_Surface* a = SDL_GetWindowSurface(window);
+    SDL_Surface* b = SDL_GetWindowSurface(other);
+    for (int y = 0; y < a->h; y++) {
+        if (memcmp((Uint8*)a->pixels + (size_t)y * a->pitch,
+            (Uint8*)b->pixels + (size_t)y * b->pitch, a->w * sizeof(Uint32)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct scene {
+    int background;
+    int sprites[3];
+};
+
+// count sprites grouped by image like the render list, some across the
+// edges of the window
+std::vector<spriteDraw> randomDraws(std::mt19937& random, const scene& images,
+    size_t count) {
+    std::vector<spriteDraw> draws;
+    for (int image : images.sprites) {
+        for (size_t i = 0; i < count / 3; i++) {
+            draws.push_back({ image, (int)(random() % (frame_width + 100)) - 60,
+                (int)(random() % (frame_height + 100)) - 60 });
+        }
+    }
+    return draws;
+}
+
+// The tiles drawn from several threads, in any order, give the frame of
+// clear() and draw()
+void tilesMatchSerial(const scene& images, SDL_Window* window, SDL_Window* other) {
+    std::mt19937 random(3);
+    for (int round = 0; round < 10; round++) {
+        std::vector<spriteDraw> draws = randomDraws(random, images, 3000);
+        surfaceBackend serial(other);
+        serial.clear(images.background);
+        serial.draw(draws.data(), draws.size());
+        serial.present();
+
+        surfaceBackend tiled(window);
+        check(tiled.tiles(), "the surface backend draws by tiles");
+        tileBins bins(frame_width, frame_height);
+        bins.build(draws);
+        std::vector<int> order(bins.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::shuffle(order.begin(), order.end(), random);
+        tiled.beginTiles(images.background, draws.data(), draws.size());
+        const unsigned chunks = 4;
+        std::vector<std::thread> threads;
+        for (unsigned chunk = 0; chunk < chunks; chunk++) {
+            threads.emplace_back([&, chunk] {
+                for (size_t i = chunk; i < order.size(); i += chunks) {
+                    int tile = order[i];
+                    tiled.drawTile(bins.rect(tile), bins.entries(tile), bins.count(tile));
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        tiled.endTiles();
+        tiled.present();
+        check(sameSurface(window, other),
+            "tiled frame equal to the serial one, round " + std::to_string(round));
+    }
+}
+
+// A backend kept over frames that change a little, redrawing only what
+// changed, gives the frame of a backend drawing all of it. Every tenth
+// frame most sprites move, the background changes once and a second
+// draw() follows the frame like the sheperd does.
+void dirtyMatchesFull(const scene& images, SDL_Window* window, SDL_Window* other,
+    bool tiled) {
+    std::mt19937 random(5);
+    std::vector<spriteDraw> draws = randomDraws(random, images, 200);
+    surfaceBackend kept(window);
+    for (int frame = 0; frame < 60; frame++) {
+        int moves = frame % 10 == 0 ? 150 : random() % 5;
+        for (int i = 0; i < moves; i++) {
+            spriteDraw& draw = draws[random() % draws.size()];
+            draw.x += (int)(random() % 9) - 4;
+            draw.y += (int)(random() % 9) - 4;
+        }
+        if (random() % 3 == 0) {
+            draws.erase(draws.begin() + random() % draws.size());
+        }
+        if (random() % 3 == 0) {
+            size_t at = random() % draws.size();
+            draws.insert(draws.begin() + at, { draws[at].sprite,
+                (int)(random() % frame_width), (int)(random() % frame_height) });
+        }
+        spriteDraw last = { images.sprites[2], frame * 7 % (int)frame_width, 300 };
+        int background = frame == 30 ? images.sprites[0] : images.background;
+        // A surface lost by the window, as application::pollEvents() finds
+        // it before the frame, is drawn again whole
+        if (frame == 45) {
+            SDL_Surface* surface = SDL_GetWindowSurface(window);
+            memset(surface->pixels, 0x5a, (size_t)surface->h * surface->pitch);
+            kept.invalidate();
+        }
+        if (tiled) {
+            tileBins bins(frame_width, frame_height);
+            bins.build(draws);
+            kept.beginTiles(background, draws.data(), draws.size());
+            for (int tile = bins.size() - 1; tile >= 0; tile--) {
+                kept.drawTile(bins.rect(tile), bins.entries(tile), bins.count(tile));
+            }
+            kept.endTiles();
+        }
+        else {
+            kept.clear(background);
+            kept.draw(draws.data(), draws.size());
+        }
+        kept.draw(&last, 1);
+        kept.present();
+
+        surfaceBackend full(other);
+        full.clear(background);
+        full.draw(draws.data(), draws.size());
+        full.draw(&last, 1);
+        full.present();
+        check(sameSurface(window, other), std::string(tiled ? "tiled" : "serial") +
+            " frame " + std::to_string(frame) + " equal to a full redraw");
+    }
+}
+} // namespace
+
+int main(int, char*[]) {
+    blendRowMatchesScalar();
+    runsMatchRows();
+
+    init();
+    SDL_Window* window = SDL_CreateWindow("renderTests", SDL_WINDOWPOS_UNDEFINED,
+        SDL_WINDOWPOS_UNDEFINED, frame_width, frame_height, SDL_WINDOW_HIDDEN);
+    SDL_Window* other = SDL_CreateWindow("renderTests", SDL_WINDOWPOS_UNDEFINED,
+        SDL_WINDOWPOS_UNDEFINED, frame_width, frame_height, SDL_WINDOW_HIDDEN);
+    if (!window || !other) {
+        throw std::runtime_error("renderTests: " + std::string(SDL_GetError()));
+    }
+    scene images;
+    images.background = spriteBank::get().load("fond.png");
+    images.sprites[0] = spriteBank::get().load("sheep.png");
+    images.sprites[1] = spriteBank::get().load("wolf.png");
+    images.sprites[2] = spriteBank::get().load("dog.png");
+    tilesMatchSerial(images, window, other);
+    dirtyMatchesFull(images, window, other, false);
+    dirtyMatchesFull(images, window, other, true);
+    SDL_DestroyWindow(other);
+    SDL_DestroyWindow(window);
+    if (failures > 0) {
+        return EXIT_FAILURE;
+    }
+    std::cout << "renderTests: all passed" << std::endl;
+    return EXIT_SUCCESS;
+}